@@ -0,0 +1,296 @@
+/**
+ * @file bench_micro.cc
+ * @brief Microbenchmarks of the helpers that run on every invocation.
+ *
+ * Usage: bench_micro [-f filter] [-r repetitions] [-t target_ms]
+ *
+ * Run with 'make bench-micro'. Each benchmark is calibrated to take about
+ * target_ms (default 20) per repetition, warmed up for one repetition, then
+ * repeated (default 10 times). For each, the JSON output on stdout has the
+ * iterations per repetition, the min, median and mean nanoseconds per op,
+ * the median TSC ticks per op (x86-64 only, else 0) and the heap
+ * allocations and bytes allocated per op. -f runs only the benchmarks whose
+ * names contain the filter.
+ *
+ * Inputs are synthetic but shaped like the real thing: environments of 10
+ * to 5000 variables with a mix of short, long (truncated) and non-printable
+ * values, and argument lists of 5 to 500 mount-like arguments.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "mwinternal.h"
+
+namespace {
+
+// Heap use, counted by the replacement operator new below. The harness is
+// single-threaded, so plain counters will do.
+uint64_t allocations = 0;
+uint64_t allocated_bytes = 0;
+
+}  // namespace
+
+void* operator new(size_t size) {
+    allocations++;
+    allocated_bytes += size;
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+namespace {
+
+const char* progname = "bench_micro";
+
+// Keep the compiler from discarding a result.
+template <typename T>
+void DoNotOptimize(const T& value) {
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+uint64_t Ticks() {
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+struct Result {
+    std::string name;
+    uint64_t iterations = 0;
+    double min_ns = 0;
+    double median_ns = 0;
+    double mean_ns = 0;
+    double ticks = 0;
+    double allocs = 0;
+    double bytes = 0;
+};
+
+class Harness {
+   public:
+    Harness(const std::string& filter, int repetitions, int64_t target_ns)
+        : filter_(filter), repetitions_(repetitions), target_ns_(target_ns) {}
+
+    void Run(const std::string& name, const std::function<void()>& op) {
+        if (name.find(filter_) == std::string::npos) {
+            return;
+        }
+        // Calibrate: double the iterations until a pass takes long enough.
+        uint64_t iterations = 1;
+        for (;;) {
+            int64_t start = mountwrapper::MonotonicNs();
+            Loop(op, iterations);
+            int64_t elapsed = mountwrapper::MonotonicNs() - start;
+            if (elapsed >= target_ns_ / 2 || iterations >= (1ULL << 30)) {
+                if (elapsed > 0) {
+                    iterations = std::max<uint64_t>(
+                        1, iterations * target_ns_ / elapsed);
+                }
+                break;
+            }
+            iterations *= 2;
+        }
+        Loop(op, iterations);  // Warm up.
+
+        std::vector<double> ns(repetitions_);
+        std::vector<double> ticks(repetitions_);
+        uint64_t allocs = allocations;
+        uint64_t bytes = allocated_bytes;
+        for (int r = 0; r < repetitions_; r++) {
+            int64_t start = mountwrapper::MonotonicNs();
+            uint64_t start_ticks = Ticks();
+            Loop(op, iterations);
+            ticks[r] =
+                static_cast<double>(Ticks() - start_ticks) / iterations;
+            ns[r] = static_cast<double>(mountwrapper::MonotonicNs() - start) /
+                    iterations;
+        }
+        double ops = static_cast<double>(iterations) * repetitions_;
+
+        Result result;
+        result.name = name;
+        result.iterations = iterations;
+        result.allocs = (allocations - allocs) / ops;
+        result.bytes = (allocated_bytes - bytes) / ops;
+        for (double v : ns) {
+            result.mean_ns += v / repetitions_;
+        }
+        std::sort(ns.begin(), ns.end());
+        std::sort(ticks.begin(), ticks.end());
+        result.min_ns = ns.front();
+        result.median_ns = ns[ns.size() / 2];
+        result.ticks = ticks[ticks.size() / 2];
+        results_.push_back(result);
+        std::cerr << progname << ": " << name << ": " << result.median_ns
+                  << " ns/op\n";
+    }
+
+    void PrintJson() const {
+        char date[32];
+        time_t now = time(nullptr);
+        struct tm bdtime;
+        gmtime_r(&now, &bdtime);
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", &bdtime);
+
+        std::cout << "{\n  \"context\": {\"date\": \"" << date
+                  << "\", \"cpus\": " << std::thread::hardware_concurrency()
+                  << ", \"repetitions\": " << repetitions_
+                  << "},\n  \"benchmarks\": [";
+        for (size_t n = 0; n < results_.size(); n++) {
+            const auto& r = results_[n];
+            std::cout << (n == 0 ? "\n" : ",\n") << "    {\"name\": \""
+                      << r.name << "\", \"iterations\": " << r.iterations
+                      << ", \"ns_per_op\": {\"min\": " << r.min_ns
+                      << ", \"median\": " << r.median_ns
+                      << ", \"mean\": " << r.mean_ns
+                      << "}, \"ticks_per_op\": " << r.ticks
+                      << ", \"allocs_per_op\": " << r.allocs
+                      << ", \"bytes_per_op\": " << r.bytes << "}";
+        }
+        std::cout << "\n  ]\n}\n";
+    }
+
+   private:
+    static void Loop(const std::function<void()>& op, uint64_t iterations) {
+        for (uint64_t i = 0; i < iterations; i++) {
+            op();
+        }
+    }
+
+    std::string filter_;
+    int repetitions_;
+    int64_t target_ns_;
+    std::vector<Result> results_;
+};
+
+//
+// Inputs.
+//
+
+// An environment of 'n' variables: mostly short values, with some paths
+// long enough to be truncated and a few with control characters.
+std::vector<std::string> MakeEnv(size_t n) {
+    std::vector<std::string> env;
+    for (size_t i = 0; i < n; i++) {
+        std::string kv = "VARIABLE_" + std::to_string(i) + "=";
+        switch (i % 8) {
+            case 0:
+                kv += "/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:"
+                      "/sbin:/bin:/opt/storageos/bin";
+                break;
+            case 1:
+                kv += "line one\nline two\ttabbed";
+                break;
+            default:
+                kv += "value-" + std::to_string(i * 7919);
+        }
+        env.push_back(kv);
+    }
+    return env;
+}
+
+// A mount command line of 'n' arguments.
+std::vector<std::string> MakeArgv(size_t n) {
+    std::vector<std::string> argv = {"/usr/bin/mount", "-t", "ext4", "-o"};
+    for (size_t i = argv.size(); i < n; i++) {
+        argv.push_back(i + 1 == n ? "/var/lib/kubelet/pods/" +
+                                        std::to_string(i) + "/volumes/mnt"
+                                  : "rw,relatime,opt" + std::to_string(i));
+    }
+    argv.resize(n);
+    return argv;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    progname = argv[0];
+    std::string filter;
+    int repetitions = 10;
+    int64_t target_ms = 20;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:r:t:")) != -1) {
+        switch (opt) {
+            case 'f':
+                filter = optarg;
+                break;
+            case 'r':
+                repetitions = atoi(optarg);
+                break;
+            case 't':
+                target_ms = atoi(optarg);
+                break;
+            default:
+                std::cerr << "Usage: " << progname
+                          << " [-f filter] [-r repetitions] [-t target_ms]\n";
+                return EXIT_FAILURE;
+        }
+    }
+    if (repetitions < 1 || target_ms < 1) {
+        std::cerr << progname
+                  << ": repetitions and target must be positive\n";
+        return EXIT_FAILURE;
+    }
+    Harness harness(filter, repetitions, target_ms * 1000000);
+
+    harness.Run("GetTimestamp",
+                [] { DoNotOptimize(mountwrapper::GetTimestamp()); });
+    harness.Run("GetNanoTimestring",
+                [] { DoNotOptimize(mountwrapper::GetNanoTimestring()); });
+
+    for (size_t len : {8, 40, 200}) {
+        std::string value(len, 'x');
+        value[len / 2] = '\n';
+        harness.Run("CanonicaliseString/len=" + std::to_string(len), [&] {
+            DoNotOptimize(mountwrapper::CanonicaliseString(value));
+        });
+    }
+
+    for (size_t n : {5, 50, 500}) {
+        auto args = MakeArgv(n);
+        harness.Run("GetVecString/argv=" + std::to_string(n),
+                    [&] { DoNotOptimize(mountwrapper::GetVecString(args)); });
+    }
+
+    for (size_t n : {10, 100, 1000, 5000}) {
+        auto env = MakeEnv(n);
+        std::string suffix = "/env=" + std::to_string(n);
+        harness.Run("GetEnvMap" + suffix, [&] {
+            DoNotOptimize(mountwrapper::GetEnvMap(env, nullptr));
+        });
+        auto map = mountwrapper::GetEnvMap(env, nullptr);
+        harness.Run("GetMapString" + suffix,
+                    [&] { DoNotOptimize(mountwrapper::GetMapString(map)); });
+    }
+
+    harness.PrintJson();
+    return EXIT_SUCCESS;
+}
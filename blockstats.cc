@@ -0,0 +1,186 @@
+/**
+ * @file blockstats.cc
+ * @brief I/O statistics deltas for the block device being mounted. See
+ * blockstats.h.
+ *
+ * The sysfs stat files are kept open in a small process-wide table and
+ * re-read with pread(), so a launcher (or batch mode) that mounts the same
+ * devices over and over doesn't pay for the path walk each time. File
+ * descriptors can't be shared between processes, so each wrapper process
+ * has its own table.
+ */
+
+#include "blockstats.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+namespace mountwrapper {
+
+namespace {
+
+constexpr size_t kCachedDevices = 16;
+
+constexpr const char* kSourcePrefixes[][2] = {
+    {"UUID=", "/dev/disk/by-uuid/"},
+    {"LABEL=", "/dev/disk/by-label/"},
+    {"PARTUUID=", "/dev/disk/by-partuuid/"},
+    {"PARTLABEL=", "/dev/disk/by-partlabel/"},
+};
+
+// Fields of the stat file; see Documentation/block/stat.rst.
+enum StatField {
+    kReads,
+    kReadMerges,
+    kReadSectors,
+    kReadTicks,
+    kWrites,
+    kWriteMerges,
+    kWriteSectors,
+    kWriteTicks,
+    kInFlight,
+    kIoTicks,
+    kTimeInQueue,
+};
+
+struct CachedDevice {
+    dev_t dev = 0;
+    int fd = -1;
+    uint64_t last_used = 0;
+};
+
+std::mutex cache_mutex;
+CachedDevice cache[kCachedDevices];
+uint64_t cache_clock = 0;
+
+// An open fd for the device's stat file, from the cache if possible; the
+// least recently used entry makes way for a new one. The caller holds
+// cache_mutex until it's done with the fd, since another batch worker may
+// evict and close it.
+int StatFd(dev_t dev) {
+    CachedDevice* victim = &cache[0];
+    for (auto& entry : cache) {
+        if (entry.fd != -1 && entry.dev == dev) {
+            entry.last_used = ++cache_clock;
+            return entry.fd;
+        }
+        if (entry.last_used < victim->last_used) {
+            victim = &entry;
+        }
+    }
+    std::string path = "/sys/dev/block/" + std::to_string(major(dev)) + ":" +
+                       std::to_string(minor(dev)) + "/stat";
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    if (victim->fd != -1) {
+        (void)close(victim->fd);
+    }
+    victim->dev = dev;
+    victim->fd = fd;
+    victim->last_used = ++cache_clock;
+    return fd;
+}
+
+bool ReadStats(dev_t dev, std::vector<uint64_t>& fields) {
+    char buf[256];
+    ssize_t len;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        int fd = StatFd(dev);
+        if (fd == -1) {
+            return false;
+        }
+        do {
+            len = pread(fd, buf, sizeof(buf) - 1, 0);
+        } while (len == -1 && errno == EINTR);
+    }
+    if (len <= 0) {
+        return false;
+    }
+    buf[len] = '\0';
+    fields.clear();
+    char* p = buf;
+    for (;;) {
+        char* end;
+        uint64_t v = strtoull(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        fields.push_back(v);
+        p = end;
+    }
+    return fields.size() > kTimeInQueue;
+}
+
+// The block device named by an argument, or 0. Only arguments that can
+// name a source are looked at: anything else may be a mountpoint, and
+// stat() on a hung NFS mount would block before umount got to clear it.
+dev_t Resolve(const std::string& arg) {
+    std::string path;
+    if (arg.rfind("/dev/", 0) == 0) {
+        if (arg.find("/..") != std::string::npos) {
+            return 0;
+        }
+        path = arg;
+    } else {
+        for (const auto& prefix : kSourcePrefixes) {
+            if (arg.rfind(prefix[0], 0) == 0) {
+                path = prefix[1] + arg.substr(strlen(prefix[0]));
+                break;
+            }
+        }
+    }
+    struct stat st;
+    if (path.empty() || stat(path.c_str(), &st) == -1 ||
+        !S_ISBLK(st.st_mode)) {
+        return 0;
+    }
+    return st.st_rdev;
+}
+
+}  // namespace
+
+void BlockStatsBefore(mw_invocation* inv) {
+    if (GetOption(inv, "blockdev_stats", "1") == "0") {
+        return;
+    }
+    for (size_t n = 1; n < inv->arg.size(); n++) {
+        if (inv->arg[n].empty()) {
+            continue;
+        }
+        dev_t dev = Resolve(inv->arg[n]);
+        if (dev != 0 && ReadStats(dev, inv->blockdev_before)) {
+            inv->blockdev = dev;
+            return;
+        }
+    }
+}
+
+std::string BlockStatsAfter(mw_invocation* inv) {
+    std::vector<uint64_t> after;
+    if (inv->blockdev == 0 || !ReadStats(inv->blockdev, after)) {
+        return "";
+    }
+    const auto& b = inv->blockdev_before;
+    auto delta = [&](StatField f) { return std::to_string(after[f] - b[f]); };
+    return " blockdev:[dev=" + std::to_string(major(inv->blockdev)) + ":" +
+           std::to_string(minor(inv->blockdev)) + ",reads=" + delta(kReads) +
+           ",read_sectors=" + delta(kReadSectors) +
+           ",writes=" + delta(kWrites) +
+           ",write_sectors=" + delta(kWriteSectors) +
+           ",io_ms=" + delta(kIoTicks) +
+           ",queue_ms=" + delta(kTimeInQueue) + "]";
+}
+
+}  // namespace mountwrapper
@@ -0,0 +1,33 @@
+/**
+ * @file blockstats.h
+ * @brief I/O statistics deltas for the block device being mounted.
+ *
+ * The first argument that names a block device (a path under /dev, or
+ * UUID=, LABEL=, PARTUUID= or PARTLABEL= via /dev/disk) is resolved with
+ * stat(2) to its st_rdev. Other arguments, mountpoints among them, are
+ * never stat()ed, so a hung mount can't hang the wrapper before the child
+ * runs. The device's /sys/dev/block/MAJ:MIN/stat is read before the
+ * fork and after the child exits. The differences show the I/O the mount
+ * caused (journal replay, fsck and so on), plus whatever else hit the
+ * device meanwhile.
+ */
+
+#ifndef BLOCKSTATS_H
+#define BLOCKSTATS_H
+
+#include <string>
+
+#include "mwinternal.h"
+
+namespace mountwrapper {
+
+// Before the fork: find the device and read its counters, unless the
+// "blockdev_stats" option is 0.
+void BlockStatsBefore(mw_invocation* inv);
+
+// After the child exits: the deltas as a " blockdev:[...]" field, or "".
+std::string BlockStatsAfter(mw_invocation* inv);
+
+}  // namespace mountwrapper
+
+#endif  // BLOCKSTATS_H
@@ -0,0 +1,206 @@
+/**
+ * @file caller.cc
+ * @brief Caller attribution. See caller.h.
+ *
+ * The cache is a table of seqlocked entries indexed by a hash of the PID
+ * and start time. Entries are overwritten freely, by whoever resolves a
+ * caller that hashes to them; a wrapper that finds its entry mid-write
+ * resolves the caller itself.
+ */
+
+#include "caller.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include <unistd.h>
+
+#include "shm.h"
+
+namespace mountwrapper {
+
+namespace {
+
+constexpr char kCallersBlockName[] = "/mountwrapper-callers-v1";
+constexpr size_t kCallerEntries = 64;
+
+struct CallerData {
+    int32_t pid;
+    uint64_t start_time;  // Clock ticks after boot, from /proc/PID/stat.
+    char comm[16];
+    char exe[256];
+    char cgroup[256];
+};
+
+struct CallerEntry {
+    std::atomic<uint32_t> seq;
+    CallerData data;
+};
+
+struct CallerTable {
+    CallerEntry entries[kCallerEntries];
+};
+
+// A string from a fixed-size field, which needn't be NUL-terminated.
+std::string Field(const char* field, size_t size) {
+    return std::string(field, strnlen(field, size));
+}
+
+// Keep to characters that can't confuse a log reader.
+std::string Sanitise(const std::string& str) {
+    std::string out = str;
+    for (auto& c : out) {
+        if (!isalnum(static_cast<unsigned char>(c)) &&
+            strchr("._-+/:@", c) == nullptr) {
+            c = '_';
+        }
+    }
+    return out;
+}
+
+void CopyField(char* dst, size_t size, const std::string& src) {
+    size_t len = std::min(src.size(), size - 1);
+    memcpy(dst, src.data(), len);
+    dst[len] = '\0';
+}
+
+// The process's start time, field 22 of its stat file, or 0.
+uint64_t StartTime(const std::string& proc) {
+    std::ifstream in(proc + "/stat");
+    std::string stat;
+    std::getline(in, stat);
+    // The comm field is in parentheses and may hold anything, spaces and
+    // parentheses included, so count from the last ')'.
+    auto pos = stat.rfind(')');
+    if (pos == std::string::npos) {
+        return 0;
+    }
+    pos++;
+    for (int field = 2; field < 21 && pos != std::string::npos; field++) {
+        pos = stat.find(' ', pos + 1);
+    }
+    return pos == std::string::npos
+               ? 0
+               : strtoull(stat.c_str() + pos + 1, nullptr, 10);
+}
+
+void Resolve(const std::string& proc, CallerData& data) {
+    std::string comm;
+    std::ifstream comm_in(proc + "/comm");
+    std::getline(comm_in, comm);
+    CopyField(data.comm, sizeof(data.comm),
+              comm.empty() ? "?" : Sanitise(comm));
+
+    char exe[sizeof(data.exe)];
+    ssize_t len = readlink((proc + "/exe").c_str(), exe, sizeof(exe) - 1);
+    CopyField(data.exe, sizeof(data.exe),
+              len > 0 ? Sanitise(std::string(exe, len)) : "?");
+
+    // The unified hierarchy's "0::/path", or failing that (cgroup v1) the
+    // systemd one's.
+    std::ifstream cgroup_in(proc + "/cgroup");
+    std::string line;
+    std::string cgroup = "?";
+    while (std::getline(cgroup_in, line)) {
+        auto colon = line.find(':', line.find(':') + 1);
+        if (colon == std::string::npos) {
+            continue;
+        }
+        if (line.rfind("0::", 0) == 0 ||
+            line.find(":name=systemd:") != std::string::npos) {
+            cgroup = line.substr(colon + 1);
+        }
+    }
+    CopyField(data.cgroup, sizeof(data.cgroup), Sanitise(cgroup));
+}
+
+bool ReadEntry(const CallerEntry& entry,
+               pid_t pid,
+               uint64_t start_time,
+               CallerData& data) {
+    for (int tries = 0; tries < 100; tries++) {
+        uint32_t before = entry.seq.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        memcpy(&data, &entry.data, sizeof(data));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (entry.seq.load(std::memory_order_relaxed) == before) {
+            return before != 0 && data.pid == pid &&
+                   data.start_time == start_time;
+        }
+    }
+    return false;
+}
+
+void WriteEntry(CallerEntry& entry, const CallerData& data) {
+    uint32_t seq = entry.seq.load(std::memory_order_relaxed);
+    if ((seq & 1) || !entry.seq.compare_exchange_strong(
+                         seq, seq + 1, std::memory_order_relaxed)) {
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&entry.data, &data, sizeof(data));
+    entry.seq.store(seq + 2, std::memory_order_release);
+}
+
+}  // namespace
+
+std::string CallerIdentity(mw_invocation* inv) {
+    if (GetOption(inv, "caller", "1") == "0") {
+        return "";
+    }
+    // Whoever asked for the run: the process calling the library, unless
+    // it names another, as the mountwrapper binary does its parent.
+    pid_t pid = getpid();
+    std::string pid_option = GetOption(inv, "caller_pid", "");
+    if (!pid_option.empty()) {
+        char* end;
+        long value = strtol(pid_option.c_str(), &end, 10);
+        if (*end == '\0' && value > 0) {
+            pid = value;
+        }
+    }
+    std::string proc = "/proc/" + std::to_string(pid);
+    uint64_t start_time = StartTime(proc);
+    if (start_time == 0) {
+        return "";
+    }
+
+    auto table = static_cast<CallerTable*>(
+        MapSharedBlock(kCallersBlockName, sizeof(CallerTable)));
+    CallerEntry* entry = nullptr;
+    if (table != nullptr) {
+        uint64_t h = static_cast<uint64_t>(pid) * 1099511628211ULL ^
+                     start_time;
+        entry = &table->entries[h % kCallerEntries];
+    }
+    CallerData data;
+    if (entry == nullptr || !ReadEntry(*entry, pid, start_time, data)) {
+        memset(&data, 0, sizeof(data));
+        data.pid = pid;
+        data.start_time = start_time;
+        Resolve(proc, data);
+        // The caller may have exited (and its PID been reused) while we
+        // looked; don't cache a mixture.
+        if (entry != nullptr && StartTime(proc) == start_time) {
+            WriteEntry(*entry, data);
+        }
+    }
+
+    // The arrays may have come from shared memory, torn or otherwise not
+    // as we'd have written them.
+    std::string comm = Sanitise(Field(data.comm, sizeof(data.comm)));
+    std::string exe = Sanitise(Field(data.exe, sizeof(data.exe)));
+    std::string cgroup = Sanitise(Field(data.cgroup, sizeof(data.cgroup)));
+    inv->caller = comm;
+    return " caller:[pid=" + std::to_string(pid) + ",comm=" + comm +
+           ",exe=" + exe + ",cgroup=" + cgroup + "]";
+}
+
+}  // namespace mountwrapper
@@ -0,0 +1,30 @@
+/**
+ * @file caller.h
+ * @brief Who ran us: the caller's name, executable and cgroup.
+ *
+ * Tells the kubelet from a CSI node plugin, systemd or someone's shell. The
+ * caller is the process using libmountwrapper, or the one the "caller_pid"
+ * option names; the mountwrapper binary names its parent, which exec'd it.
+ * Resolving them takes a handful of /proc reads, so the result is cached
+ * in shared memory keyed by the caller's PID and start time (which
+ * together survive PID reuse), and a storm of mounts from one caller
+ * resolves it once.
+ */
+
+#ifndef CALLER_H
+#define CALLER_H
+
+#include <string>
+
+#include "mwinternal.h"
+
+namespace mountwrapper {
+
+// Identify the caller, setting inv->caller to its name, unless the
+// "caller" option is 0. Returns the execute record's
+// " caller:[pid=...,comm=...,exe=...,cgroup=...]" field, or "".
+std::string CallerIdentity(mw_invocation* inv);
+
+}  // namespace mountwrapper
+
+#endif  // CALLER_H
@@ -0,0 +1,175 @@
+/**
+ * @file detector.cc
+ * @brief Node-wide online change-point detection on exec-to-exit latency.
+ *
+ * Each binary gets a slot in a shared-memory table holding an EWMA and
+ * EWMVar of ln(latency), plus a two-sided CUSUM of the standardised
+ * residuals. Working in log space keeps the heavy tail of mount latencies
+ * from swamping the statistics, and clamping each residual means a single
+ * outlier can't raise an alarm on its own: only a sustained shift can.
+ *
+ * Updates are O(1) and lock-free: each field is updated with its own
+ * compare-and-swap loop. Concurrent wrappers can therefore see slightly
+ * inconsistent snapshots of a slot, which only blurs the statistics a
+ * little, and never blocks a mount.
+ */
+
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "mwinternal.h"
+#include "shm.h"
+
+namespace mountwrapper {
+
+static constexpr char kDetectorBlockName[] = "/mountwrapper-detector-v1";
+static constexpr size_t kDetectorSlots = 256;
+static constexpr size_t kDetectorProbes = 16;
+
+static constexpr double kAlpha = 0.05;      // EWMA weight of a new sample.
+static constexpr uint64_t kWarmup = 20;     // Samples before alarms.
+static constexpr double kMinStddev = 0.05;  // In ln space, i.e. ~5%.
+static constexpr double kMaxResidual = 4.0;
+static constexpr double kCusumSlack = 0.5;    // k, in standard deviations.
+static constexpr double kCusumThreshold = 5;  // h, in standard deviations.
+
+namespace {
+
+struct alignas(64) DetectorSlot {
+    std::atomic<uint64_t> key;    // HashKey(binary); 0 means free.
+    std::atomic<uint64_t> count;  // Samples seen.
+    // doubles, stored as their bit patterns so they can be CASed.
+    std::atomic<uint64_t> mean;  // EWMA of ln(latency_ns).
+    std::atomic<uint64_t> var;   // EWMVar of ln(latency_ns).
+    std::atomic<uint64_t> cusum_up;
+    std::atomic<uint64_t> cusum_down;
+    std::atomic<uint64_t> alarms;
+};
+
+struct DetectorBlock {
+    DetectorSlot slots[kDetectorSlots];
+};
+
+double Load(const std::atomic<uint64_t>& a) {
+    uint64_t bits = a.load(std::memory_order_relaxed);
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+uint64_t Bits(double d) {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return bits;
+}
+
+// Apply f to the double in 'a' atomically; returns the new value.
+template <typename F>
+double Update(std::atomic<uint64_t>& a, F f) {
+    uint64_t old = a.load(std::memory_order_relaxed);
+    for (;;) {
+        double o;
+        memcpy(&o, &old, sizeof(o));
+        double n = f(o);
+        if (a.compare_exchange_weak(old, Bits(n),
+                                    std::memory_order_relaxed)) {
+            return n;
+        }
+    }
+}
+
+// Find or claim the slot for 'key', probing a bounded number of slots.
+DetectorSlot* FindSlot(DetectorBlock* block, uint64_t key) {
+    for (size_t n = 0; n < kDetectorProbes; n++) {
+        auto& slot = block->slots[(key + n) % kDetectorSlots];
+        uint64_t current = slot.key.load(std::memory_order_acquire);
+        if (current == 0 &&
+            slot.key.compare_exchange_strong(current, key,
+                                             std::memory_order_acq_rel)) {
+            return &slot;
+        }
+        if (current == key) {
+            return &slot;
+        }
+    }
+    return nullptr;  // Table full around here; go without.
+}
+
+// Add 'delta' to a CUSUM accumulator, floored at zero. If it crosses the
+// threshold, reset it and return true. Only the process that actually moves
+// it over the line gets the alarm.
+bool CusumStep(std::atomic<uint64_t>& acc, double delta) {
+    uint64_t old = acc.load(std::memory_order_relaxed);
+    for (;;) {
+        double o;
+        memcpy(&o, &old, sizeof(o));
+        double n = std::max(0.0, o + delta);
+        bool alarm = n > kCusumThreshold;
+        if (acc.compare_exchange_weak(old, Bits(alarm ? 0.0 : n),
+                                      std::memory_order_relaxed)) {
+            return alarm;
+        }
+    }
+}
+
+}  // namespace
+
+ChangePoint DetectChangePoint(const mw_invocation* inv, int64_t latency_ns) {
+    ChangePoint cp;
+    if (latency_ns <= 0 || GetOption(inv, "detect", "1") == "0") {
+        return cp;
+    }
+    auto block = static_cast<DetectorBlock*>(
+        MapSharedBlock(kDetectorBlockName, sizeof(DetectorBlock)));
+    if (block == nullptr) {
+        return cp;
+    }
+    auto slot = FindSlot(block, HashKey(inv->binary));
+    if (slot == nullptr) {
+        return cp;
+    }
+
+    double x = std::log(static_cast<double>(latency_ns));
+    // The first sample seeds the mean, before it's counted: anyone who
+    // saw a count without the mean would take it to be 0, and feed a huge
+    // residual into the statistics.
+    uint64_t unseeded = 0;
+    if (slot->mean.compare_exchange_strong(unseeded, Bits(x),
+                                           std::memory_order_relaxed)) {
+        slot->count.fetch_add(1, std::memory_order_relaxed);
+        return cp;
+    }
+    uint64_t n = slot->count.fetch_add(1, std::memory_order_relaxed);
+
+    double mean = Load(slot->mean);
+    double var = Load(slot->var);
+    double sd = std::max(std::sqrt(var), kMinStddev);
+    double z = std::clamp((x - mean) / sd, -kMaxResidual, kMaxResidual);
+
+    double diff = x - mean;
+    Update(slot->mean, [diff](double m) { return m + kAlpha * diff; });
+    Update(slot->var, [diff](double v) {
+        return (1 - kAlpha) * (v + kAlpha * diff * diff);
+    });
+
+    if (n < kWarmup) {
+        return cp;
+    }
+    if (CusumStep(slot->cusum_up, z - kCusumSlack)) {
+        cp.direction = "up";
+    } else if (CusumStep(slot->cusum_down, -z - kCusumSlack)) {
+        cp.direction = "down";
+    }
+    if (cp.direction != nullptr) {
+        slot->alarms.fetch_add(1, std::memory_order_relaxed);
+        cp.baseline_ns = std::exp(mean);
+        cp.z = z;
+    }
+    return cp;
+}
+
+}  // namespace mountwrapper
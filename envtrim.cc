@@ -0,0 +1,89 @@
+/**
+ * @file envtrim.cc
+ * @brief Trimmed child environments. See envtrim.h.
+ *
+ * The kept variables aren't copied anywhere: envp points at the strings
+ * already in inv->env, and is sized for all of them up front, so trimming
+ * allocates once however big the environment is.
+ */
+
+#include "envtrim.h"
+
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace mountwrapper {
+
+namespace {
+
+constexpr const char* kAlwaysKept[] = {
+    "PATH", "LANG", "LANGUAGE", "LC_*", "WRAPPER_*", kTraceParentEnvVar,
+};
+
+// Whether the name at the start of 'kv' (up to the '=') matches 'pattern'.
+bool NameMatches(const std::string& kv, const char* pattern, size_t len) {
+    if (len > 0 && pattern[len - 1] == '*') {
+        return kv.compare(0, len - 1, pattern, len - 1) == 0;
+    }
+    return kv.size() > len && kv.compare(0, len, pattern, len) == 0 &&
+           kv[len] == '=';
+}
+
+bool Kept(const mw_invocation* inv, const std::string& kv) {
+    for (const char* pattern : kAlwaysKept) {
+        if (NameMatches(kv, pattern, strlen(pattern))) {
+            return true;
+        }
+    }
+    for (const auto& pattern : inv->env_allowlist) {
+        if (NameMatches(kv, pattern.c_str(), pattern.size())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+std::string EnvTrimSummary(mw_invocation* inv) {
+    inv->trim_env = GetOption(inv, "trim_env", "0") == "1";
+    if (!inv->trim_env) {
+        return "";
+    }
+    std::istringstream ss(GetOption(inv, "env_allowlist", ""));
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        if (!name.empty()) {
+            inv->env_allowlist.push_back(name);
+        }
+    }
+    size_t kept = 0;
+    size_t dropped = 0;
+    size_t dropped_bytes = 0;
+    for (const auto& kv : inv->env) {
+        if (Kept(inv, kv)) {
+            kept++;
+        } else {
+            dropped++;
+            dropped_bytes += kv.size() + 1;
+        }
+    }
+    return " env_trim:[kept=" + std::to_string(kept) +
+           ",dropped=" + std::to_string(dropped) +
+           ",dropped_bytes=" + std::to_string(dropped_bytes) + "]";
+}
+
+void BuildChildEnvp(mw_invocation* inv, std::vector<char*>& envp) {
+    envp.clear();
+    envp.reserve(inv->env.size() + 1);
+    for (auto& kv : inv->env) {
+        if (!inv->trim_env || Kept(inv, kv)) {
+            envp.push_back(&kv[0]);
+        }
+    }
+    envp.push_back(nullptr);
+}
+
+}  // namespace mountwrapper
@@ -0,0 +1,33 @@
+/**
+ * @file envtrim.h
+ * @brief A trimmed environment for the child, to cut the cost of the exec.
+ *
+ * execve() copies every environment string into the new process, and pods
+ * can hand us thousands of variables that mount(8) never looks at. With
+ * the "trim_env" option set to 1 the child gets only PATH, the locale
+ * variables (LANG, LANGUAGE, LC_*), our own WRAPPER_* variables (so nested
+ * wrappers behave) and TRACEPARENT, plus the names in the "env_allowlist"
+ * option: comma-separated, a trailing '*' matching any suffix.
+ */
+
+#ifndef ENVTRIM_H
+#define ENVTRIM_H
+
+#include <string>
+#include <vector>
+
+#include "mwinternal.h"
+
+namespace mountwrapper {
+
+// Read the options and, if trimming, return the execute record's
+// " env_trim:[kept=...,dropped=...,dropped_bytes=...]" field; else "".
+std::string EnvTrimSummary(mw_invocation* inv);
+
+// Fill 'envp' with the child's environment, null-terminated. The pointers
+// are into inv->env, which must outlive them.
+void BuildChildEnvp(mw_invocation* inv, std::vector<char*>& envp);
+
+}  // namespace mountwrapper
+
+#endif  // ENVTRIM_H
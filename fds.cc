@@ -0,0 +1,162 @@
+/**
+ * @file fds.cc
+ * @brief Inherited descriptor inventory and hygiene. See fds.h.
+ *
+ * In the child we use close_range(CLOSE_RANGE_CLOEXEC) on the gaps between
+ * the descriptors to keep, rather than closing anything outright: the
+ * exec can still fail, and our error report needs stderr. Kernels before
+ * 5.11 don't have it, so then the descriptors found before the fork are
+ * marked one at a time.
+ */
+
+#include "fds.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/close_range.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace mountwrapper {
+
+namespace {
+
+// How many descriptors get their type logged.
+constexpr size_t kInventoryTypes = 8;
+
+std::string FdType(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        return "unknown";
+    }
+    switch (st.st_mode & S_IFMT) {
+        case S_IFREG:
+            return "file";
+        case S_IFDIR:
+            return "dir";
+        case S_IFIFO:
+            return "pipe";
+        case S_IFSOCK:
+            return "socket";
+        case S_IFCHR:
+            return "chr";
+        case S_IFBLK:
+            return "blk";
+    }
+    // anon_inode:[eventfd], anon_inode:inotify and the like.
+    char target[64];
+    std::string link = "/proc/self/fd/" + std::to_string(fd);
+    ssize_t len = readlink(link.c_str(), target, sizeof(target) - 1);
+    if (len <= 0) {
+        return "other";
+    }
+    std::string name(target, len);
+    if (name.rfind("anon_inode:", 0) == 0) {
+        name.erase(0, 11);
+        name.erase(std::remove(name.begin(), name.end(), '['), name.end());
+        name.erase(std::remove(name.begin(), name.end(), ']'), name.end());
+    }
+    return name;
+}
+
+// The descriptors above stderr that an exec would pass on, in order.
+bool InheritedFds(std::vector<int>& fds) {
+    DIR* dir = opendir("/proc/self/fd");
+    if (dir == nullptr) {
+        return false;
+    }
+    while (struct dirent* ent = readdir(dir)) {
+        char* end;
+        long fd = strtol(ent->d_name, &end, 10);
+        if (*end != '\0' || end == ent->d_name || fd <= STDERR_FILENO ||
+            fd == dirfd(dir)) {
+            continue;
+        }
+        int flags = fcntl(fd, F_GETFD);
+        if (flags != -1 && !(flags & FD_CLOEXEC)) {
+            fds.push_back(fd);
+        }
+    }
+    (void)closedir(dir);
+    std::sort(fds.begin(), fds.end());
+    return true;
+}
+
+bool Kept(const mw_invocation* inv, int fd) {
+    return std::binary_search(inv->keep_fds.begin(), inv->keep_fds.end(),
+                              fd);
+}
+
+}  // namespace
+
+std::string FdInventory(mw_invocation* inv) {
+    bool inventory = GetOption(inv, "fd_inventory", "1") != "0";
+    inv->close_fds = GetOption(inv, "close_fds", "0") == "1";
+    if (inv->close_fds) {
+        std::istringstream ss(GetOption(inv, "keep_fds", ""));
+        std::string fd;
+        while (std::getline(ss, fd, ',')) {
+            int n = atoi(fd.c_str());
+            if (n > STDERR_FILENO) {
+                inv->keep_fds.push_back(n);
+            }
+        }
+        std::sort(inv->keep_fds.begin(), inv->keep_fds.end());
+    }
+    if (!inventory && !inv->close_fds) {
+        return "";
+    }
+    if (!InheritedFds(inv->inherited_fds) || !inventory) {
+        return "";
+    }
+
+    std::ostringstream ss;
+    ss << " fds:[inherited=" << inv->inherited_fds.size();
+    if (inv->close_fds) {
+        size_t closed = 0;
+        for (int fd : inv->inherited_fds) {
+            closed += !Kept(inv, fd);
+        }
+        ss << ",closed=" << closed;
+    }
+    for (size_t n = 0;
+         n < inv->inherited_fds.size() && n < kInventoryTypes; n++) {
+        int fd = inv->inherited_fds[n];
+        ss << "," << fd << "=" << FdType(fd);
+    }
+    ss << "]";
+    return ss.str();
+}
+
+void CloseInheritedFds(const mw_invocation* inv) {
+    if (!inv->close_fds) {
+        return;
+    }
+    unsigned int first = STDERR_FILENO + 1;
+    bool ok = true;
+    for (int keep : inv->keep_fds) {
+        if (ok && static_cast<unsigned int>(keep) > first) {
+            ok = syscall(SYS_close_range, first, keep - 1,
+                         CLOSE_RANGE_CLOEXEC) == 0;
+        }
+        first = keep + 1;
+    }
+    if (ok && syscall(SYS_close_range, first, ~0U, CLOSE_RANGE_CLOEXEC) ==
+                  0) {
+        return;
+    }
+    for (int fd : inv->inherited_fds) {
+        if (!Kept(inv, fd)) {
+            (void)fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+}
+
+}  // namespace mountwrapper
@@ -0,0 +1,33 @@
+/**
+ * @file fds.h
+ * @brief Descriptors the child inherits: an inventory for the execute
+ * record, and optionally keeping them from the child altogether.
+ *
+ * Whatever descriptors our caller (the kubelet, a CSI plugin) leaked to us
+ * without close-on-exec go on to the wrapped binary, where they slow the
+ * exec and can keep things busy for as long as it runs. With the
+ * "close_fds" option set to 1 every inherited descriptor above stderr is
+ * marked close-on-exec in the child, except those listed in the
+ * "keep_fds" option (comma-separated numbers).
+ */
+
+#ifndef FDS_H
+#define FDS_H
+
+#include <string>
+
+#include "mwinternal.h"
+
+namespace mountwrapper {
+
+// Before the fork: find the inherited descriptors. Returns the execute
+// record's " fds:[...]" field, or "" if the "fd_inventory" option is 0.
+std::string FdInventory(mw_invocation* inv);
+
+// In the child, just before the exec: apply "close_fds". Only makes
+// async-signal-safe calls.
+void CloseInheritedFds(const mw_invocation* inv);
+
+}  // namespace mountwrapper
+
+#endif  // FDS_H
@@ -0,0 +1,146 @@
+/**
+ * @file flightrec.cc
+ * @brief Shared-memory flight recorder. See flightrec.h.
+ */
+
+#include "flightrec.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include "shm.h"
+
+namespace mountwrapper {
+
+static_assert(sizeof(FlightEntry) == kFlightEntrySize,
+              "flight recorder entries should be exactly one slot");
+
+static constexpr char kTruncated[] = " ...[truncated]";
+
+// How long one read of the ring waits, in all, for entries to be written.
+static constexpr auto kWriteWait = std::chrono::milliseconds(10);
+
+// Whether a line from the ring could be one of our records. They're
+// copied into the log verbatim, so a torn entry, or one written by
+// whoever else got at the ring, mustn't get anything else there.
+static bool PlausibleRecord(const std::string& line) {
+    if (line.empty()) {
+        return false;
+    }
+    for (unsigned char c : line) {
+        if (c < 32) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<std::string> ReadFlightRing(const FlightRing* ring,
+                                        uint64_t from,
+                                        uint64_t to) {
+    std::vector<std::string> lines;
+    from = std::max(from, to > kFlightEntries ? to - kFlightEntries : 0);
+    auto deadline = std::chrono::steady_clock::now() + kWriteWait;
+    for (uint64_t t = from; t < to; t++) {
+        const auto& entry = ring->entries[t % kFlightEntries];
+        // Ticket t has been handed out, but its writer may not have
+        // finished (or started) the entry. That takes microseconds, and a
+        // dump that skipped it would claim it anyway and no later one
+        // would look again, so give the writer a moment.
+        uint32_t before = entry.seq.load(std::memory_order_acquire);
+        while ((before & 1 ||
+                entry.ticket.load(std::memory_order_relaxed) < t + 1) &&
+               std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+            before = entry.seq.load(std::memory_order_acquire);
+        }
+        if (before & 1 ||
+            entry.ticket.load(std::memory_order_relaxed) != t + 1) {
+            continue;
+        }
+        size_t length = entry.length;
+        if (length > sizeof(entry.text)) {
+            continue;
+        }
+        std::string text(entry.text, length);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (entry.seq.load(std::memory_order_relaxed) != before) {
+            continue;
+        }
+        // The records are newline-separated, and none of them may hold
+        // anything but printable text. Take all of an entry or none of it.
+        std::vector<std::string> records;
+        size_t pos = 0;
+        bool valid = true;
+        while (valid && pos < text.size()) {
+            auto end = text.find('\n', pos);
+            if (end == std::string::npos) {
+                end = text.size();
+            }
+            records.push_back(text.substr(pos, end - pos));
+            valid = PlausibleRecord(records.back());
+            pos = end + 1;
+        }
+        if (valid) {
+            lines.insert(lines.end(), records.begin(), records.end());
+        }
+    }
+    return lines;
+}
+
+bool FlightRecord(const mw_invocation* inv,
+                  bool failed,
+                  std::vector<std::string>& dump) {
+    if (GetOption(inv, "flight_recorder", "0") == "0") {
+        return false;
+    }
+    auto ring = static_cast<FlightRing*>(
+        MapSharedBlock(kFlightBlockName, sizeof(FlightRing)));
+    if (ring == nullptr) {
+        return false;
+    }
+
+    // Join our records into the entry, truncating the last one that
+    // doesn't fit.
+    std::string text;
+    for (const auto& line : inv->output) {
+        if (!text.empty()) {
+            text += "\n";
+        }
+        text += line;
+    }
+    constexpr size_t kCapacity = sizeof(FlightEntry::text);
+    if (text.size() > kCapacity) {
+        text.resize(kCapacity - strlen(kTruncated));
+        text += kTruncated;
+    }
+
+    uint64_t ticket = ring->next.fetch_add(1, std::memory_order_relaxed);
+    auto& entry = ring->entries[ticket % kFlightEntries];
+    uint32_t seq = entry.seq.load(std::memory_order_relaxed);
+    entry.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    entry.ticket.store(ticket + 1, std::memory_order_relaxed);
+    memcpy(entry.text, text.data(), text.size());
+    entry.length = text.size();
+    entry.seq.store(seq + 2, std::memory_order_release);
+
+    if (failed) {
+        // Claim everything up to and including our entry. Whoever moves
+        // 'dumped' gets to log that range, so overlapping failures don't
+        // log records twice.
+        uint64_t to = ticket + 1;
+        uint64_t from = ring->dumped.load(std::memory_order_relaxed);
+        while (from < to && !ring->dumped.compare_exchange_weak(
+                                from, to, std::memory_order_relaxed)) {
+        }
+        if (from < to) {
+            dump = ReadFlightRing(ring, from, to);
+        }
+    }
+    return true;
+}
+
+}  // namespace mountwrapper
@@ -0,0 +1,65 @@
+/**
+ * @file flightrec.h
+ * @brief Shared-memory flight recorder of recent invocations.
+ *
+ * With the "flight_recorder" option set, each invocation copies its records
+ * into a node-wide ring instead of appending them to the log. Only when an
+ * invocation fails (non-zero exit, signal, or execve() failure) are the
+ * ring's records written to the log, giving the failure the context of what
+ * ran just before it while keeping steady-state log I/O near zero. mwflight
+ * dumps the ring on demand.
+ *
+ * Each entry holds one invocation's records, newline-separated and truncated
+ * to fit, published under a seqlock. The header remembers how far the log
+ * has been brought up to date, so successive failures don't dump the same
+ * records twice.
+ */
+
+#ifndef FLIGHTREC_H
+#define FLIGHTREC_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mwinternal.h"
+
+namespace mountwrapper {
+
+static constexpr char kFlightBlockName[] = "/mountwrapper-flight-v1";
+static constexpr size_t kFlightEntries = 256;
+static constexpr size_t kFlightEntrySize = 4096;
+
+struct alignas(64) FlightEntry {
+    std::atomic<uint32_t> seq;      // Seqlock; odd while being written.
+    uint32_t length;                // Bytes of text used.
+    std::atomic<uint64_t> ticket;   // Which invocation this is, plus one.
+    char text[kFlightEntrySize - 16];
+};
+
+struct FlightRing {
+    std::atomic<uint64_t> next;    // Tickets handed out so far.
+    std::atomic<uint64_t> dumped;  // Tickets below this are in the log.
+    FlightEntry entries[kFlightEntries];
+};
+
+// Copy the records for tickets [from, to) out of the ring, oldest first.
+// Entries not yet written are waited for, up to 10ms in all; those still
+// unwritten then, or that have been overwritten, are skipped.
+std::vector<std::string> ReadFlightRing(const FlightRing* ring,
+                                        uint64_t from,
+                                        uint64_t to);
+
+// Wrapper side. If the flight recorder is enabled, record the invocation's
+// output in the ring; if 'failed', return everything not yet logged (which
+// includes this invocation's records) for the caller to write out, and
+// otherwise nothing. Returns false if the recorder is disabled or
+// unavailable, in which case the caller should log as usual.
+bool FlightRecord(const mw_invocation* inv,
+                  bool failed,
+                  std::vector<std::string>& dump);
+
+}  // namespace mountwrapper
+
+#endif  // FLIGHTREC_H
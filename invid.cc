@@ -0,0 +1,107 @@
+/**
+ * @file invid.cc
+ * @brief Time-ordered unique invocation IDs (UUIDv7, RFC 9562).
+ *
+ * The layout is a 48-bit Unix millisecond timestamp, then 12 bits of
+ * sub-millisecond time (so IDs from one clock sort in creation order), then
+ * 62 random bits. The random bits come from a xoshiro256** generator seeded
+ * once per process (and again in any fork()ed child that keeps running)
+ * from getrandom(2), so generating an ID costs a clock read, a few shifts
+ * and the formatting, not a syscall.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+#include <pthread.h>
+#include <sys/random.h>
+#include <unistd.h>
+
+#include "mwinternal.h"
+
+namespace mountwrapper {
+
+namespace {
+
+// Generator state; thread-local so batch workers don't contend on it.
+thread_local uint64_t rng_state[4];
+thread_local uint64_t rng_generation = 0;
+
+// Bumped in fork() children, so they don't repeat the parent's sequence.
+std::atomic<uint64_t> fork_generation{1};
+
+void ReseedAfterFork() {
+    fork_generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t Rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+}  // namespace
+
+uint64_t RandomU64() {
+    uint64_t generation = fork_generation.load(std::memory_order_relaxed);
+    if (rng_generation != generation) {
+        static pthread_once_t once = PTHREAD_ONCE_INIT;
+        pthread_once(&once, [] {
+            pthread_atfork(nullptr, nullptr, ReseedAfterFork);
+        });
+        if (getrandom(rng_state, sizeof(rng_state), 0) !=
+            sizeof(rng_state)) {
+            // No entropy to be had; fall back to something that at least
+            // differs between processes and threads.
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            rng_state[0] = ts.tv_nsec ^ (uint64_t(ts.tv_sec) << 32);
+            rng_state[1] = getpid();
+            rng_state[2] = reinterpret_cast<uintptr_t>(&rng_state);
+            rng_state[3] = 0x9e3779b97f4a7c15ULL;
+        }
+        rng_generation = generation;
+    }
+
+    // xoshiro256**.
+    uint64_t* s = rng_state;
+    uint64_t result = Rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = Rotl(s[3], 45);
+    return result;
+}
+
+std::string NewInvocationId() {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME, &ts) == -1) {
+        error_sys(errno, "clock_gettime() failed");
+    }
+    uint64_t ms = uint64_t(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+    // The fraction of the millisecond, scaled to 12 bits.
+    uint64_t sub_ms = (uint64_t(ts.tv_nsec % 1000000) << 12) / 1000000;
+    uint64_t rand = RandomU64();
+
+    uint64_t hi = (ms << 16) | (0x7ULL << 12) | sub_ms;
+    uint64_t lo = (0x2ULL << 62) | (rand >> 2);
+
+    static const char kHex[] = "0123456789abcdef";
+    char out[36];
+    int pos = 0;
+    for (int nibble = 0; nibble < 32; nibble++) {
+        if (nibble == 8 || nibble == 12 || nibble == 16 || nibble == 20) {
+            out[pos++] = '-';
+        }
+        uint64_t word = nibble < 16 ? hi : lo;
+        out[pos++] = kHex[(word >> (60 - 4 * (nibble % 16))) & 0xf];
+    }
+    return std::string(out, sizeof(out));
+}
+
+}  // namespace mountwrapper
@@ -0,0 +1,802 @@
+/**
+ * @file libmountwrapper.cc
+ * @author André Lucas (andre.lucas@storageos.com)
+ * @brief Capture, spawn, wait and log logic shared by the mountwrapper binary
+ * and in-process launchers. See libmountwrapper.h for the API.
+ *
+ * @copyright Copyright (c) 2021
+ *
+ * The same care is needed here as in the binary: the log file isn't touched
+ * until mw_invocation_flush(), after the child has been reaped, so we don't
+ * serialise concurrent mounts on it and hide the races we're looking for.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <libgen.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/timex.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "blockstats.h"
+#include "caller.h"
+#include "envtrim.h"
+#include "fds.h"
+#include "flightrec.h"
+#include "mwinternal.h"
+#include "nfsstats.h"
+#include "residency.h"
+#include "slots.h"
+#include "spool.h"
+#include "taskstats.h"
+#include "xxhash64.h"
+
+namespace fs = std::filesystem;
+
+namespace mountwrapper {
+
+[[noreturn]] void error_sys(int err, const std::string& message) {
+    std::cerr << "mountwrapper (wrapper): " << message << ": "
+              << strerror(err) << "\n";
+    exit(EXIT_FAILURE);
+}
+
+std::string EnvStringWithDefault(const std::string& env,
+                                 const std::string& default_value) {
+    char* present = getenv(env.c_str());
+    if (present == nullptr || (std::string(present) == "")) {
+        return default_value;
+    }
+    return std::string(present);
+}
+
+std::string GetOption(const mw_invocation* inv,
+                      const std::string& name,
+                      const std::string& default_value) {
+    auto it = inv->options.find(name);
+    if (it != inv->options.end()) {
+        return it->second;
+    }
+    std::string env = "WRAPPER_" + name;
+    std::transform(env.begin(), env.end(), env.begin(),
+                   [](unsigned char c) { return toupper(c); });
+    return EnvStringWithDefault(env, default_value);
+}
+
+size_t SizeOption(const mw_invocation* inv,
+                  const std::string& name,
+                  size_t default_value) {
+    std::string value = GetOption(inv, name, "");
+    char* end;
+    unsigned long long size = strtoull(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || size == 0) {
+        return default_value;
+    }
+    return size;
+}
+
+std::string GetNanoTimestring() {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME, &ts) == -1) {
+        error_sys(errno, "clock_gettime() failed");
+    }
+    std::ostringstream ss;
+    ss << ts.tv_sec << "." << std::setfill('0') << std::setw(9)
+       << std::to_string(ts.tv_nsec);
+    return ss.str();
+}
+
+// Generate a timestamp of now (via clock_gettime()).
+std::string GetTimestamp() {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME, &ts) == -1) {
+        error_sys(errno, "clock_gettime() failed");
+    }
+    char ftime[64];
+    time_t tt = ts.tv_sec;
+    struct tm bdtime;
+
+    if (gmtime_r(&tt, &bdtime) == nullptr) {
+        error_sys(errno, "gmtime_r() failed");
+    }
+
+    if (strftime(ftime, sizeof(ftime), "%Y-%m-%dT%H:%M:%S", &bdtime) == 0) {
+        error_sys(errno, "strftime() failed");
+    }
+    std::ostringstream ss;
+    // formatted_time dot microsec (==nsec / 1000).
+    ss << ftime << "." << std::setfill('0') << std::setw(6)
+       << ts.tv_nsec / 1000;
+
+    return ss.str();
+}
+
+// Room left at the end of a capped list for the marker saying how many
+// items didn't fit: ",...+<count> more".
+static constexpr size_t kOmittedRoom = 32;
+
+static void AppendOmitted(std::string& out, size_t omitted) {
+    if (omitted > 0) {
+        out += out.empty() ? "...+" : ",...+";
+        out += std::to_string(omitted);
+        out += " more";
+    }
+}
+
+// Add 'item' to a comma-separated list unless it would take the list past
+// 'max_bytes', leaving room for the marker if more items follow.
+static bool AppendItem(std::string& out,
+                       size_t max_bytes,
+                       bool last,
+                       const std::string& a,
+                       const std::string& b,
+                       const std::string& c) {
+    size_t len = (out.empty() ? 0 : 1) + a.size() + b.size() + c.size();
+    if (out.size() + len + (last ? 0 : kOmittedRoom) > max_bytes) {
+        return false;
+    }
+    if (!out.empty()) {
+        out += ',';
+    }
+    out += a;
+    out += b;
+    out += c;
+    return true;
+}
+
+std::string GetVecString(const std::vector<std::string>& vec,
+                         size_t max_bytes) {
+    static const std::string kQuote = "\"";
+    size_t total = 0;
+    for (const auto& item : vec) {
+        total += item.size() + 3;
+    }
+    if (total == 0 || total - 1 <= max_bytes) {
+        max_bytes = SIZE_MAX;  // It all fits; no need to save room.
+    }
+    std::string out;
+    out.reserve(std::min(total, max_bytes));
+    size_t n = 0;
+    for (; n < vec.size(); n++) {
+        if (!AppendItem(out, max_bytes, n + 1 == vec.size(), kQuote, vec[n],
+                        kQuote)) {
+            break;
+        }
+    }
+    AppendOmitted(out, vec.size() - n);
+    return out;
+}
+
+std::string GetMapString(const std::map<std::string, std::string>& map,
+                         size_t max_bytes) {
+    static const std::string kEquals = "=";
+    size_t total = 0;
+    for (const auto& kv : map) {
+        total += kv.first.size() + kv.second.size() + 2;
+    }
+    if (total == 0 || total - 1 <= max_bytes) {
+        max_bytes = SIZE_MAX;  // It all fits; no need to save room.
+    }
+    std::string out;
+    out.reserve(std::min(total, max_bytes));
+    size_t n = 0;
+    for (auto it = map.begin(); it != map.end(); ++it, n++) {
+        if (!AppendItem(out, max_bytes, n + 1 == map.size(), it->first,
+                        kEquals, it->second)) {
+            break;
+        }
+    }
+    AppendOmitted(out, map.size() - n);
+    return out;
+}
+
+std::map<std::string, std::string> GetEnvMap(
+    const std::vector<std::string>& env,
+    std::string* traceparent) {
+    std::map<std::string, std::string> map;
+    for (const auto& kv : env) {
+        auto pos = kv.find("=");
+        if (pos != kv.npos) {
+            std::string key = kv.substr(0, pos);
+            std::string value = kv.substr(pos + 1, kv.size());  // After '='.
+            if (traceparent != nullptr && key == kTraceParentEnvVar) {
+                *traceparent = value;
+            }
+            value = CanonicaliseString(value);
+            map[key] = value;
+        }
+    }
+    return map;
+}
+
+std::string CanonicaliseString(const std::string& input) {
+    bool truncated = input.size() > kMaxEnvVarValueLength;
+    size_t keep = truncated ? kMaxEnvVarValueLength - 3 : input.size();
+    std::string output;
+    output.reserve(truncated ? kMaxEnvVarValueLength + 17 : keep);
+    output.resize(keep);
+    for (size_t n = 0; n < keep; n++) {
+        char c = input[n];
+        output[n] = c < 32 || c > 127 ? '.' : c;
+    }
+    if (truncated) {
+        // A fingerprint of the whole value, so different long values stay
+        // distinguishable.
+        static const char kHex[] = "0123456789abcdef";
+        uint64_t hash = XxHash64(input.data(), input.size());
+        output += "...#";
+        for (int shift = 60; shift >= 0; shift -= 4) {
+            output += kHex[(hash >> shift) & 0xf];
+        }
+    }
+    return output;
+}
+
+int64_t MonotonicNs() {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1) {
+        error_sys(errno, "clock_gettime() failed");
+    }
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+std::string GetClockSample() {
+    struct timex tx;
+    memset(&tx, 0, sizeof(tx));  // modes == 0: read only.
+    int state = adjtimex(&tx);
+    if (state == -1) {
+        return "clock:[unavailable]";
+    }
+    // The offset is in microseconds unless the kernel says otherwise.
+    long long offset_ns = tx.offset;
+    if (!(tx.status & STA_NANO)) {
+        offset_ns *= 1000;
+    }
+    bool synced = state != TIME_ERROR && !(tx.status & STA_UNSYNC);
+    std::ostringstream ss;
+    ss << "clock:[offset_ns=" << offset_ns << ",maxerror_us=" << tx.maxerror
+       << ",esterror_us=" << tx.esterror << ",sync=" << (synced ? 1 : 0)
+       << "]";
+    return ss.str();
+}
+
+// Set a variable in the child's environment, replacing any existing value.
+static void SetChildEnv(mw_invocation* inv,
+                        const std::string& name,
+                        const std::string& value) {
+    std::string prefix = name + "=";
+    inv->env.erase(std::remove_if(inv->env.begin(), inv->env.end(),
+                                  [&prefix](const std::string& kv) {
+                                      return kv.rfind(prefix, 0) == 0;
+                                  }),
+                   inv->env.end());
+    inv->env.push_back(prefix + value);
+}
+
+std::string RecordPrefix(const mw_invocation* inv) {
+    return "runtimestamp " + inv->runtimestamp + " id " + inv->id;
+}
+
+// Append an item to the given vector with a timestamp prepended.
+void Log(std::vector<std::string>& out, const std::string& str) {
+    out.emplace_back(GetTimestamp() + " " + str);
+}
+
+// If something goes wrong, dump what we have to stdout so it's not entirely
+// lost.
+void PanicDump(const std::vector<std::string>& output) {
+    static std::mutex dump_mutex;
+    std::lock_guard<std::mutex> lock(dump_mutex);
+    for (const auto& line : output) {
+        std::cout << line << "\n";
+    }
+}
+
+static const char* const kOverheadNames[kOverheadPhases] = {
+    "copy", "canon", "format", "setup", "fork",
+    "complete", "mkdir", "open", "write"};
+
+// Append the overhead_ns:[...] field to the completed record, if there is
+// one and it hasn't been done yet.
+static void AppendOverhead(mw_invocation* inv) {
+    if (inv->overhead_line < 0 ||
+        inv->overhead_line >= static_cast<int>(inv->output.size())) {
+        return;
+    }
+    std::string fields;
+    for (int p = 0; p < kOverheadPhases; p++) {
+        if (inv->overhead_ns[p] >= 0) {
+            fields += fields.empty() ? "" : ",";
+            fields += kOverheadNames[p];
+            fields += "=" + std::to_string(inv->overhead_ns[p]);
+        }
+    }
+    inv->output[inv->overhead_line] += " overhead_ns:[" + fields + "]";
+    inv->overhead_line = -1;
+}
+
+// Keep records[first...] that couldn't be logged in the spool (see
+// spool.h), or failing that dump them to stdout. Returns whether they were
+// spooled.
+static bool SpoolOrDump(mw_invocation* inv,
+                        const std::string& logfile,
+                        size_t first) {
+    AppendOverhead(inv);
+    if (SpoolRecords(inv, logfile, inv->output, first)) {
+        return true;
+    }
+    PanicDump(std::vector<std::string>(inv->output.begin() + first,
+                                       inv->output.end()));
+    return false;
+}
+
+// Dump all regular output to the log file, after anything spooled while it
+// couldn't be written. Returns 0 if the records were logged or spooled, or
+// an errno value if the log directory couldn't be created or the log file
+// opened or written and they went to stdout.
+//
+// 'Regular output' means the wrapped program was successfully exec'd, but
+// doesn't necessarily mean it returned with a zero exit code.
+static int WriteLog(const std::string& logfile, mw_invocation* inv) {
+    const auto& output = inv->output;
+    std::error_code ec;
+    auto logdir = fs::path{logfile}.parent_path();
+
+    // fs::create_directories() returns failure if the directory already
+    // existed, so check the error code as well.
+
+    int64_t start = MonotonicNs();
+    bool created = fs::create_directories(logdir, ec);
+    inv->overhead_ns[kOverheadMkdir] = MonotonicNs() - start;
+    if (!created && ec) {
+        std::cerr << "Failed to create log directory " << logdir
+                  << ": " << ec.message() << "\n";
+
+        return SpoolOrDump(inv, logfile, 0) ? 0 : ec.value();
+    }
+
+    // Use stdio.h so it's clear that we're using specific open flags.
+    start = MonotonicNs();
+    int logfd = open(logfile.c_str(),
+                     O_CREAT | O_WRONLY | O_APPEND | O_CLOEXEC, 0644);
+    inv->overhead_ns[kOverheadOpen] = MonotonicNs() - start;
+    if (logfd == -1) {
+        int err = errno;
+        std::cerr << "Failed to open log file " << logfile
+                  << ": " << strerror(err) << "\n";
+        return SpoolOrDump(inv, logfile, 0) ? 0 : err;
+    }
+
+    std::string spool = SpoolPathFor(inv, logfile);
+    if (!spool.empty()) {
+        // Older records first. If they can't be moved now, the next
+        // wrapper will try again.
+        (void)ReplaySpool(spool, logfd, nullptr);
+    }
+
+    start = MonotonicNs();
+    for (size_t n = 0; n < output.size(); n++) {
+        // The completed record can't time its own write, so it carries the
+        // time taken by the records ahead of it.
+        if (static_cast<int>(n) == inv->overhead_line) {
+            inv->overhead_ns[kOverheadWrite] = MonotonicNs() - start;
+            AppendOverhead(inv);
+        }
+        // Write the line and its newline in one go, so concurrent writers
+        // (other wrappers, or batch workers) can't split a record, and
+        // without copying the line to add the newline.
+        struct iovec iov[2] = {
+            {const_cast<char*>(output[n].data()), output[n].size()},
+            {const_cast<char*>("\n"), 1},
+        };
+        auto ret = writev(logfd, iov, 2);
+        if (ret != static_cast<ssize_t>(output[n].size() + 1)) {
+            int err = (ret == -1) ? errno : EIO;
+            (void)close(logfd);
+            std::cerr << "Failed to write log file " << logfile
+                      << ": " << strerror(err) << "\n";
+            return SpoolOrDump(inv, logfile, n) ? 0 : err;
+        }
+    }
+    (void)close(logfd);
+    return 0;
+}
+
+// With the "shards" option set to N > 1, records go to one of N files,
+// <logfile>.0 to <logfile>.N-1, so concurrent wrappers don't all serialise on
+// one inode's lock. "shard_by" picks the shard by the CPU we're running on
+// ("cpu", the default) or by a hash of the child's pid ("pid"). Use mwmerge
+// to put the shards back together.
+static std::string ShardLogfile(const mw_invocation* inv,
+                                const std::string& logfile) {
+    unsigned long shards =
+        strtoul(GetOption(inv, "shards", "1").c_str(), nullptr, 10);
+    if (shards <= 1) {
+        return logfile;
+    }
+
+    long key = -1;
+    if (GetOption(inv, "shard_by", "cpu") == "cpu") {
+        key = sched_getcpu();
+    }
+    if (key < 0) {
+        // Fibonacci hashing spreads sequential pids across the shards.
+        uint32_t pid = inv->pid != -1 ? inv->pid : getpid();
+        key = (pid * 2654435761U) >> 16;
+    }
+    return logfile + "." + std::to_string(key % shards);
+}
+
+}  // namespace mountwrapper
+
+using namespace mountwrapper;
+
+extern "C" {
+
+int mw_invocation_create(mw_invocation** invp,
+                         const char* binary,
+                         const char* const argv[],
+                         const char* const envp[]) {
+    if (invp == nullptr || binary == nullptr || argv == nullptr ||
+        argv[0] == nullptr) {
+        return EINVAL;
+    }
+    if (envp == nullptr) {
+        envp = const_cast<const char* const*>(environ);
+    }
+
+    int64_t start = MonotonicNs();
+    auto inv = new (std::nothrow) mw_invocation;
+    if (inv == nullptr) {
+        return ENOMEM;
+    }
+    std::fill(std::begin(inv->overhead_ns), std::end(inv->overhead_ns), -1);
+    try {
+        inv->binary = binary;
+        // Copy the arguments to a string vector that isn't a pain to use.
+        for (auto ap = argv; *ap != nullptr; ap++) {
+            inv->arg.push_back(*ap);
+        }
+        // Likewise copy the environment.
+        for (auto ep = envp; *ep != nullptr; ep++) {
+            inv->env.push_back(*ep);
+        }
+        std::string argv0 = inv->arg[0];
+        inv->progname = basename(&argv0[0]);
+    } catch (const std::bad_alloc&) {
+        delete inv;
+        return ENOMEM;
+    }
+    inv->overhead_ns[kOverheadCopy] = MonotonicNs() - start;
+    *invp = inv;
+    return 0;
+}
+
+int mw_invocation_setopt(mw_invocation* inv,
+                         const char* name,
+                         const char* value) {
+    if (inv == nullptr || name == nullptr) {
+        return EINVAL;
+    }
+    if (value == nullptr) {
+        inv->options.erase(name);
+    } else {
+        inv->options[name] = value;
+    }
+    return 0;
+}
+
+int mw_invocation_spawn(mw_invocation* inv) {
+    if (inv == nullptr || inv->pid != -1) {
+        return EINVAL;
+    }
+
+    int64_t start = MonotonicNs();
+    std::string traceparent;
+    auto env = GetEnvMap(inv->env, &traceparent);
+    int64_t now = MonotonicNs();
+    inv->overhead_ns[kOverheadCanon] = now - start;
+    start = now;
+
+    // Prepare a string for the log file. However big argv and the
+    // environment are, the record stays within the caps: argv may have
+    // half of the record's, and the environment what's left.
+    inv->runtimestamp = GetNanoTimestring();
+    inv->id = NewInvocationId();
+    size_t field_cap =
+        SizeOption(inv, "max_field_bytes", kDefaultMaxFieldBytes);
+    size_t record_cap = std::max(
+        SizeOption(inv, "max_record_bytes", kDefaultMaxRecordBytes),
+        2 * kRecordFixedBytes);
+    size_t lists_cap = record_cap - kRecordFixedBytes;
+    inv->argstr = GetVecString(inv->arg, std::min(field_cap, lists_cap / 2));
+    auto envstr = GetMapString(
+        env, std::min(field_cap, lists_cap - inv->argstr.size()));
+    std::string record = RecordPrefix(inv);
+    record.reserve(record.size() + inv->argstr.size() + envstr.size() +
+                   kRecordFixedBytes);
+    record += " execute '" + inv->binary + "' argv:[";
+    record += inv->argstr;
+    record += "] environment:[";
+    record += envstr;
+    record += "] ";
+    record += GetClockSample();
+    record += CallerIdentity(inv);
+    record += ExecResidency(inv);
+    record += FdInventory(inv);
+    record += EnvTrimSummary(inv);
+    Log(inv->output, record);
+    now = MonotonicNs();
+    inv->overhead_ns[kOverheadFormat] = now - start;
+    start = now;
+    SlotRegister(inv);
+
+    // Tell the child (and anything it runs) who it is, replacing any ID
+    // inherited from a wrapper further up, and make it part of our trace.
+    SetChildEnv(inv, kInvocationIdEnvVar, inv->id);
+    TraceStart(inv, traceparent);
+    if (inv->trace.active) {
+        SetChildEnv(inv, kTraceParentEnvVar, TraceParentForChild(inv));
+    }
+
+    // execve() wants mutable, null-terminated arrays. Build them before the
+    // fork(), as our caller may be multithreaded.
+    std::vector<char*> child_argv;
+    for (auto& a : inv->arg) {
+        child_argv.push_back(&a[0]);
+    }
+    child_argv.push_back(nullptr);
+    std::vector<char*> child_envp;
+    BuildChildEnvp(inv, child_envp);
+    std::string exec_error = inv->progname + " (wrapper): execve() failed: ";
+
+    //
+    // fork(), then exec() in the child.
+    //
+
+    // When tracing, a close-on-exec pipe tells us when the exec happened:
+    // the read end sees EOF once the child has exec'd or exited.
+    int exec_pipe[2] = {-1, -1};
+    if (inv->trace.sampled && pipe2(exec_pipe, O_CLOEXEC) == -1) {
+        exec_pipe[0] = exec_pipe[1] = -1;
+    }
+
+    NfsStatsBefore(inv);
+    BlockStatsBefore(inv);
+    TaskstatsListen(inv);
+
+    inv->spawn_ns = MonotonicNs();
+    inv->overhead_ns[kOverheadSetup] = inv->spawn_ns - start;
+    auto cpid = fork();
+    if (cpid == -1) {
+        int err = errno;
+        if (exec_pipe[0] != -1) {
+            (void)close(exec_pipe[0]);
+            (void)close(exec_pipe[1]);
+        }
+        TaskstatsClose(inv);
+        SlotRelease(inv);
+        return err;
+    }
+    if (cpid == 0) {
+        // In child. exec the real mount binary, but do nothing with the
+        // output.
+        CloseInheritedFds(inv);
+        execve(inv->binary.c_str(), child_argv.data(), child_envp.data());
+
+        // If we get here, the exec failed. Stick to write(2) and _exit(2),
+        // since our parent may be multithreaded.
+        const char* reason = strerror(errno);
+        (void)!write(STDERR_FILENO, exec_error.c_str(), exec_error.size());
+        (void)!write(STDERR_FILENO, reason, strlen(reason));
+        (void)!write(STDERR_FILENO, "\n", 1);
+
+        // Exit status 128 isn't used by the mount command. We'll use it to
+        // indicate an execve() failure to the parent.
+        _exit(128);
+    }
+
+    // In parent.
+    inv->trace.forked_ns = MonotonicNs();
+    inv->overhead_ns[kOverheadFork] = inv->trace.forked_ns - inv->spawn_ns;
+    inv->pid = cpid;
+    SlotSetPhase(inv, kPhaseRunning);
+    if (exec_pipe[0] != -1) {
+        (void)close(exec_pipe[1]);
+        char c;
+        while (read(exec_pipe[0], &c, 1) == -1 && errno == EINTR) {
+        }
+        (void)close(exec_pipe[0]);
+        inv->trace.exec_ns = MonotonicNs();
+    }
+    return 0;
+}
+
+int mw_invocation_wait(mw_invocation* inv, int* exit_code) {
+    if (inv == nullptr || exit_code == nullptr || inv->pid == -1 ||
+        inv->reaped) {
+        return EINVAL;
+    }
+
+    int wstatus;
+    int w;
+    do {
+        w = waitpid(inv->pid, &wstatus, 0);
+    } while (w == -1 && errno == EINTR);
+    if (w == -1) {
+        return errno;
+    }
+    inv->exit_ns = MonotonicNs();
+    inv->reaped = true;
+    inv->wstatus = wstatus;
+
+    std::ostringstream ss;
+    ss << RecordPrefix(inv) << " completed '" << inv->binary << "' args:["
+       << inv->argstr << "]";
+    auto prefix = ss.str();
+    ss = {};
+    ss << prefix << " ";
+
+    int32_t status = EXIT_FAILURE;  // For mounttop: exit code, or -signal.
+    if (WIFEXITED(wstatus)) {
+        int ec = WEXITSTATUS(wstatus);
+        status = ec;
+        if (ec == 128) {
+            ss << "failed to execv(2) (ec==128)";
+        } else {
+            ss << "exit with code " << ec;
+        }
+        *exit_code = ec;
+
+    } else if (WIFSIGNALED(wstatus)) {
+        int sig = WTERMSIG(wstatus);
+        ss << "exit with signal " << sig;
+        *exit_code = EXIT_FAILURE;
+        status = -sig;
+
+    } else {
+        ss << "stopped with unknown status " << wstatus;
+        *exit_code = EXIT_FAILURE;
+    }
+
+    inv->failed = status != EXIT_SUCCESS;
+    int64_t latency_ns = inv->exit_ns - inv->spawn_ns;
+    SlotComplete(inv, status);
+    SlotSetPhase(inv, kPhaseLogging);
+    ss << " latency_ns=" << latency_ns;
+    if (!inv->caller.empty()) {
+        ss << " caller=" << inv->caller;
+    }
+    ss << TaskstatsCollect(inv)
+       << NfsStatsAfter(inv) << BlockStatsAfter(inv);
+    auto cp = DetectChangePoint(inv, latency_ns);
+    if (cp.direction != nullptr) {
+        ss << " changepoint=" << cp.direction;
+    }
+    // The overhead is appended when the record is written out.
+    inv->overhead_line = static_cast<int>(inv->output.size());
+    Log(inv->output, ss.str());
+
+    if (cp.direction != nullptr) {
+        // A marker record, so change points are easy to find in the log.
+        ss = {};
+        ss << RecordPrefix(inv) << " changepoint '" << inv->binary
+           << "' direction=" << cp.direction << " latency_ns=" << latency_ns
+           << " baseline_ns=" << static_cast<int64_t>(cp.baseline_ns)
+           << " z=" << std::fixed << std::setprecision(2) << cp.z;
+        Log(inv->output, ss.str());
+    }
+    inv->overhead_ns[kOverheadComplete] = MonotonicNs() - inv->exit_ns;
+    return 0;
+}
+
+int mw_invocation_skip(mw_invocation* inv, const char* reason) {
+    if (inv == nullptr || reason == nullptr || inv->pid != -1) {
+        return EINVAL;
+    }
+    inv->runtimestamp = GetNanoTimestring();
+    inv->id = NewInvocationId();
+    std::ostringstream ss;
+    ss << RecordPrefix(inv) << " skipped '" << inv->binary << "' args:["
+       << GetVecString(inv->arg,
+                       SizeOption(inv, "max_field_bytes",
+                                  kDefaultMaxFieldBytes))
+       << "] " << reason;
+    Log(inv->output, ss.str());
+    return 0;
+}
+
+int mw_invocation_flush(mw_invocation* inv) {
+    if (inv == nullptr) {
+        return EINVAL;
+    }
+    // Open the log file only after all the raceable stuff has taken place,
+    // so we don't influence the result.
+    auto logfile =
+        ShardLogfile(inv, GetOption(inv, "output", kDefaultOutputFile));
+
+    if (GetOption(inv, "flight_recorder", "0") != "0") {
+        // The records may never reach the log, so finish them now.
+        AppendOverhead(inv);
+    }
+
+    std::vector<std::string> dump;
+    if (FlightRecord(inv, inv->failed, dump)) {
+        // The flight recorder has our records. Only touch the log if we
+        // failed, and then with everything it hasn't seen yet.
+        inv->output.clear();
+        SlotRelease(inv);
+        if (dump.empty()) {
+            TraceExport(inv);
+            return 0;
+        }
+        std::ostringstream ss;
+        ss << RecordPrefix(inv) << " flightrecorder '" << inv->binary
+           << "' dumping " << dump.size() << " lines after failure";
+        Log(inv->output, ss.str());
+        inv->output.insert(inv->output.end(), dump.begin(), dump.end());
+    }
+
+    int err = WriteLog(logfile, inv);
+    inv->output.clear();
+    SlotRelease(inv);
+    // Last, so a slow or missing collector can't cost us the records.
+    TraceExport(inv);
+    return err;
+}
+
+pid_t mw_invocation_pid(const mw_invocation* inv) {
+    return inv == nullptr ? -1 : inv->pid;
+}
+
+void mw_invocation_destroy(mw_invocation* inv) {
+    if (inv == nullptr) {
+        return;
+    }
+    if (inv->pid != -1 && !inv->reaped) {
+        while (waitpid(inv->pid, nullptr, 0) == -1 && errno == EINTR) {
+        }
+    }
+    TaskstatsClose(inv);
+    SlotRelease(inv);
+    delete inv;
+}
+
+int mw_run(const char* binary,
+           const char* const argv[],
+           const char* const envp[],
+           int* exit_code) {
+    mw_invocation* inv;
+    int err = mw_invocation_create(&inv, binary, argv, envp);
+    if (err != 0) {
+        return err;
+    }
+    err = mw_invocation_spawn(inv);
+    if (err == 0) {
+        err = mw_invocation_wait(inv, exit_code);
+    }
+    // Flush whatever we have even if something failed, so the execute
+    // record isn't lost.
+    int flush_err = mw_invocation_flush(inv);
+    mw_invocation_destroy(inv);
+    return err != 0 ? err : flush_err;
+}
+
+}  // extern "C"
@@ -0,0 +1,81 @@
+/**
+ * @file libmountwrapper.h
+ * @brief C API for spawning a binary with mountwrapper-style logging.
+ *
+ * This lets other launchers instrument their mounts in-process, producing
+ * exactly the records the mountwrapper binary would, without an extra exec.
+ * The same constraint applies as for the binary: nothing touches the log file
+ * until the child has been reaped (see mw_invocation_flush()).
+ *
+ * All functions returning int return 0 on success or a positive errno value
+ * on failure. The API is stable; MW_API_VERSION changes only when it breaks.
+ *
+ * Options are named after the wrapper's environment variables, minus the
+ * WRAPPER_ prefix and in lower case (e.g. "output" for WRAPPER_OUTPUT). An
+ * option that isn't set explicitly is taken from the process environment,
+ * then from the built-in default.
+ */
+
+#ifndef LIBMOUNTWRAPPER_H
+#define LIBMOUNTWRAPPER_H
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MW_API_VERSION 1
+
+typedef struct mw_invocation mw_invocation;
+
+/* Create an invocation of 'binary' with the given null-terminated argument
+ * vector (argv[0] included, and passed to the child unchanged) and
+ * environment. If envp is NULL, the process environment is used. All strings
+ * are copied. */
+int mw_invocation_create(mw_invocation **invp,
+                         const char *binary,
+                         const char *const argv[],
+                         const char *const envp[]);
+
+/* Set an option (see above). A NULL value reverts to the default. */
+int mw_invocation_setopt(mw_invocation *inv,
+                         const char *name,
+                         const char *value);
+
+/* Record the execute record, then fork() and exec the binary. */
+int mw_invocation_spawn(mw_invocation *inv);
+
+/* Wait for the child and record its completion. On success *exit_code is
+ * what the wrapper would exit with: the child's exit code, 128 if the exec
+ * failed, or EXIT_FAILURE if it was killed by a signal. */
+int mw_invocation_wait(mw_invocation *inv, int *exit_code);
+
+/* Record that the invocation was deliberately not run, and why. */
+int mw_invocation_skip(mw_invocation *inv, const char *reason);
+
+/* Append the recorded lines to the log file. If the log can't be written,
+ * the records are kept in a spool and moved into the log by a later flush
+ * (see spool.h), and this still returns 0. Only if the spool fails too are
+ * they dumped to stdout, as a last resort, and the error returned. Sampled
+ * trace spans are exported after that, best-effort (see trace.cc). */
+int mw_invocation_flush(mw_invocation *inv);
+
+/* The child's pid, or -1 if it hasn't been spawned. */
+pid_t mw_invocation_pid(const mw_invocation *inv);
+
+/* Free the invocation. A child that was spawned but not waited for is reaped
+ * first, without logging its completion. */
+void mw_invocation_destroy(mw_invocation *inv);
+
+/* Create, spawn, wait, flush and destroy in one call. */
+int mw_run(const char *binary,
+           const char *const argv[],
+           const char *const envp[],
+           int *exit_code);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBMOUNTWRAPPER_H */
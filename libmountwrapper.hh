@@ -0,0 +1,113 @@
+/**
+ * @file libmountwrapper.hh
+ * @brief C++ RAII wrapper around the libmountwrapper C API.
+ *
+ * Failures are reported as std::system_error, carrying the errno value from
+ * the C API.
+ */
+
+#ifndef LIBMOUNTWRAPPER_HH
+#define LIBMOUNTWRAPPER_HH
+
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "libmountwrapper.h"
+
+namespace mountwrapper {
+
+class Invocation {
+   public:
+    // If envp is null, the process environment is used.
+    Invocation(const std::string& binary,
+               const std::vector<std::string>& argv,
+               const char* const* envp = nullptr) {
+        std::vector<const char*> cargv;
+        for (const auto& a : argv) {
+            cargv.push_back(a.c_str());
+        }
+        cargv.push_back(nullptr);
+        Check(mw_invocation_create(&inv_, binary.c_str(), cargv.data(), envp),
+              "mw_invocation_create()");
+    }
+
+    ~Invocation() {
+        if (inv_ != nullptr) {
+            mw_invocation_destroy(inv_);
+        }
+    }
+
+    Invocation(const Invocation&) = delete;
+    Invocation& operator=(const Invocation&) = delete;
+    Invocation(Invocation&& other) noexcept
+        : inv_(std::exchange(other.inv_, nullptr)),
+          exit_code_(other.exit_code_) {}
+    Invocation& operator=(Invocation&& other) noexcept {
+        std::swap(inv_, other.inv_);
+        std::swap(exit_code_, other.exit_code_);
+        return *this;
+    }
+
+    void SetOption(const std::string& name, const std::string& value) {
+        Check(mw_invocation_setopt(inv_, name.c_str(), value.c_str()),
+              "mw_invocation_setopt()");
+    }
+
+    void Spawn() {
+        Check(mw_invocation_spawn(inv_), "mw_invocation_spawn()");
+    }
+
+    int Wait() {
+        int exit_code;
+        Check(mw_invocation_wait(inv_, &exit_code), "mw_invocation_wait()");
+        exit_code_ = exit_code;
+        return exit_code;
+    }
+
+    void Skip(const std::string& reason) {
+        Check(mw_invocation_skip(inv_, reason.c_str()),
+              "mw_invocation_skip()");
+    }
+
+    void Flush() {
+        Check(mw_invocation_flush(inv_), "mw_invocation_flush()");
+    }
+
+    // Spawn, wait and flush; returns the exit code to report. Like mw_run(),
+    // flushes whatever there is even if the spawn or wait fails, so the
+    // execute record isn't lost.
+    int Run() {
+        int exit_code;
+        try {
+            Spawn();
+            exit_code = Wait();
+        } catch (...) {
+            (void)mw_invocation_flush(inv_);
+            throw;
+        }
+        Flush();
+        return exit_code;
+    }
+
+    pid_t pid() const { return mw_invocation_pid(inv_); }
+
+    // The exit code Wait() returned, or -1 if it hasn't. Lets a caller of
+    // Run() still report the child's exit code when only the flush failed.
+    int exit_code() const { return exit_code_; }
+
+   private:
+    static void Check(int err, const char* what) {
+        if (err != 0) {
+            throw std::system_error(err, std::generic_category(), what);
+        }
+    }
+
+    mw_invocation* inv_ = nullptr;
+    int exit_code_ = -1;
+};
+
+}  // namespace mountwrapper
+
+#endif  // LIBMOUNTWRAPPER_HH
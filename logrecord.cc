@@ -0,0 +1,217 @@
+/**
+ * @file logrecord.cc
+ * @brief Parsing of mountwrapper log lines. See logrecord.h.
+ */
+
+#include "logrecord.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+namespace mountwrapper {
+
+bool ParseNanoTimestring(const std::string& str, int64_t& ns) {
+    auto dot = str.find('.');
+    if (dot == std::string::npos || dot == 0 || str.size() - dot - 1 != 9) {
+        return false;
+    }
+    char* end;
+    long long secs = strtoll(str.c_str(), &end, 10);
+    if (end != str.c_str() + dot) {
+        return false;
+    }
+    long long nsecs = strtoll(str.c_str() + dot + 1, &end, 10);
+    if (*end != '\0') {
+        return false;
+    }
+    ns = secs * 1000000000LL + nsecs;
+    return true;
+}
+
+bool ParseTimestamp(const std::string& str, int64_t& ns) {
+    struct tm bdtime;
+    memset(&bdtime, 0, sizeof(bdtime));
+    const char* rest = strptime(str.c_str(), "%Y-%m-%dT%H:%M:%S", &bdtime);
+    if (rest == nullptr || *rest != '.') {
+        return false;
+    }
+    char* end;
+    long usecs = strtol(rest + 1, &end, 10);
+    if (end != rest + 7 || *end != '\0') {
+        return false;
+    }
+    ns = static_cast<int64_t>(timegm(&bdtime)) * 1000000000LL +
+         usecs * 1000LL;
+    return true;
+}
+
+// Return the space-separated word starting at 'pos', advancing 'pos' past
+// it and the following space.
+static std::string NextWord(const std::string& line, size_t& pos) {
+    auto end = line.find(' ', pos);
+    if (end == std::string::npos) {
+        end = line.size();
+    }
+    std::string word = line.substr(pos, end - pos);
+    pos = std::min(end + 1, line.size());
+    return word;
+}
+
+bool GetIntField(const std::string& fields,
+                 const std::string& name,
+                 int64_t& value) {
+    std::string key = name + "=";
+    size_t pos = 0;
+    while ((pos = fields.find(key, pos)) != std::string::npos) {
+        if (pos == 0 || fields[pos - 1] == ',' || fields[pos - 1] == '[' ||
+            fields[pos - 1] == ' ') {
+            const char* start = fields.c_str() + pos + key.size();
+            char* end;
+            value = strtoll(start, &end, 10);
+            return end != start;
+        }
+        pos += key.size();
+    }
+    return false;
+}
+
+// Pick up the clock:[...] sample from an execute record.
+static void ParseClock(LogRecord& rec) {
+    static const std::string kClock = " clock:[";
+    auto pos = rec.line.rfind(kClock);
+    if (pos == std::string::npos) {
+        return;
+    }
+    auto end = rec.line.find(']', pos);
+    std::string fields = rec.line.substr(pos + kClock.size(),
+                                         end - pos - kClock.size());
+    int64_t synced = 0;
+    if (GetIntField(fields, "offset_ns", rec.clock_offset_ns)) {
+        rec.has_clock = true;
+        GetIntField(fields, "maxerror_us", rec.clock_maxerror_us);
+        GetIntField(fields, "sync", synced);
+        rec.clock_synced = synced != 0;
+    }
+}
+
+// Pick up the args, exit status and latency from a completed record.
+static void ParseCompletion(LogRecord& rec) {
+    static const std::string kArgs = "' args:[";
+    static const char* const kStatusText[] = {
+        "] exit with code ", "] exit with signal ", "] failed to execv(2)",
+        "] stopped with unknown status "};
+
+    auto args = rec.line.find(kArgs);
+    if (args == std::string::npos) {
+        return;
+    }
+    args += kArgs.size();
+    size_t status_pos = std::string::npos;
+    for (size_t n = 0; n < sizeof(kStatusText) / sizeof(kStatusText[0]);
+         n++) {
+        auto pos = rec.line.rfind(kStatusText[n]);
+        if (pos == std::string::npos || pos < args) {
+            continue;
+        }
+        rec.args = rec.line.substr(args, pos - args);
+        status_pos = pos;
+        const char* value = rec.line.c_str() + pos + strlen(kStatusText[n]);
+        switch (n) {
+            case 0:
+                rec.status = atoi(value);
+                break;
+            case 1:
+                rec.status = -atoi(value);
+                break;
+            case 2:
+                rec.status = kStatusExecFailed;
+                break;
+            default:
+                rec.status = EXIT_FAILURE;
+        }
+        rec.has_status = true;
+        break;
+    }
+
+    if (status_pos == std::string::npos) {
+        return;
+    }
+    // Look for fields only after the args, which could contain anything.
+    if (!GetIntField(rec.line.substr(status_pos), "latency_ns",
+                     rec.latency_ns) &&
+        rec.timestamp_ns > rec.runtimestamp_ns) {
+        // Older logs: the completion was logged just after the exit.
+        rec.latency_ns = rec.timestamp_ns - rec.runtimestamp_ns;
+    }
+
+    static const std::string kCaller = " caller=";
+    auto caller = rec.line.find(kCaller, status_pos);
+    if (caller != std::string::npos) {
+        caller += kCaller.size();
+        rec.caller = rec.line.substr(caller,
+                                     rec.line.find(' ', caller) - caller);
+    }
+
+    static const std::string kOverhead = " overhead_ns:[";
+    auto pos = rec.line.rfind(kOverhead);
+    if (pos == std::string::npos || pos < status_pos) {
+        return;
+    }
+    pos += kOverhead.size();
+    auto end = rec.line.find(']', pos);
+    if (end == std::string::npos) {
+        return;
+    }
+    while (pos < end) {
+        auto eq = rec.line.find('=', pos);
+        auto comma = std::min(rec.line.find(',', pos), end);
+        if (eq > comma) {
+            break;
+        }
+        rec.overhead_ns.emplace_back(
+            rec.line.substr(pos, eq - pos),
+            strtoll(rec.line.c_str() + eq + 1, nullptr, 10));
+        pos = comma + 1;
+    }
+}
+
+bool ParseLogRecord(const std::string& line, LogRecord& rec) {
+    rec = LogRecord{};
+    rec.line = line;
+
+    size_t pos = 0;
+    if (!ParseTimestamp(NextWord(line, pos), rec.timestamp_ns)) {
+        rec.timestamp_ns = 0;
+        return false;
+    }
+    if (NextWord(line, pos) != "runtimestamp") {
+        return false;
+    }
+    rec.runtimestamp = NextWord(line, pos);
+    if (!ParseNanoTimestring(rec.runtimestamp, rec.runtimestamp_ns)) {
+        rec.runtimestamp.clear();
+        rec.runtimestamp_ns = 0;
+        return false;
+    }
+    rec.kind = NextWord(line, pos);
+    if (rec.kind == "id") {
+        rec.id = NextWord(line, pos);
+        rec.kind = NextWord(line, pos);
+    }
+    if (pos < line.size() && line[pos] == '\'') {
+        auto end = line.find('\'', pos + 1);
+        if (end != std::string::npos) {
+            rec.binary = line.substr(pos + 1, end - pos - 1);
+        }
+    }
+    if (rec.kind == "execute") {
+        ParseClock(rec);
+    } else if (rec.kind == "completed") {
+        ParseCompletion(rec);
+    }
+    return true;
+}
+
+}  // namespace mountwrapper
@@ -0,0 +1,87 @@
+/**
+ * @file logrecord.h
+ * @brief Parsing of mountwrapper log lines, for the tools that read logs.
+ *
+ * A record looks like
+ *
+ *   <UTC timestamp> runtimestamp <secs.nsecs> id <uuid> <kind> '<binary>' ...
+ *
+ * where kind is execute, completed, skipped, changepoint or flightrecorder.
+ * Older logs have no 'id <uuid>'. Lines that don't look like
+ * this are still returned (so tools can pass them through), with kind empty.
+ */
+
+#ifndef LOGRECORD_H
+#define LOGRECORD_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mountwrapper {
+
+struct LogRecord {
+    std::string line;          // The whole line, without the newline.
+    int64_t timestamp_ns = 0;  // The line's UTC prefix, or 0.
+    int64_t runtimestamp_ns = 0;  // The run's start; 0 if absent.
+    std::string runtimestamp;  // As written.
+    std::string id;            // Invocation ID; empty in older logs.
+    std::string kind;          // See above, or empty.
+    std::string binary;
+
+    // From completed records.
+    std::string args;   // The args:[...] list, as written.
+    bool has_status = false;
+    int status = 0;     // Exit code (128 for execve() failure), or -signal.
+    int64_t latency_ns = 0;  // Exec to exit; estimated for older logs.
+    std::string caller;      // The caller's name; empty if not logged.
+    // The wrapper's own time by phase, from the overhead_ns:[...] field, in
+    // the order written.
+    std::vector<std::pair<std::string, int64_t>> overhead_ns;
+
+    // From the execute record's clock:[...] sample, if there is one.
+    bool has_clock = false;
+    int64_t clock_offset_ns = 0;  // Add to local time to correct it.
+    int64_t clock_maxerror_us = 0;
+    bool clock_synced = false;
+};
+
+// Status codes as used in LogRecord::status.
+static constexpr int kStatusExecFailed = 128;
+
+inline bool StatusFailed(int status) {
+    return status != 0;
+}
+
+// Parse 'line' into 'rec'. Returns false if it isn't a wrapper record, in
+// which case only rec.line (and possibly rec.timestamp_ns) are set.
+bool ParseLogRecord(const std::string& line, LogRecord& rec);
+
+// The key joining a run's records: its ID, or the runtimestamp for logs
+// that predate IDs.
+inline const std::string& JoinKey(const LogRecord& rec) {
+    return rec.id.empty() ? rec.runtimestamp : rec.id;
+}
+
+// Find 'name=' in the comma-separated 'fields' and parse its value as an
+// integer. Returns false if absent or malformed.
+bool GetIntField(const std::string& fields,
+                 const std::string& name,
+                 int64_t& value);
+
+// The time a record should be ordered by: its runtimestamp, falling back to
+// the line timestamp for lines without one.
+inline int64_t RecordTime(const LogRecord& rec) {
+    return rec.runtimestamp_ns != 0 ? rec.runtimestamp_ns : rec.timestamp_ns;
+}
+
+// Parse "secs.nsecs" into nanoseconds. Returns false if malformed.
+bool ParseNanoTimestring(const std::string& str, int64_t& ns);
+
+// Parse the "%Y-%m-%dT%H:%M:%S.usecs" UTC line prefix into nanoseconds.
+bool ParseTimestamp(const std::string& str, int64_t& ns);
+
+}  // namespace mountwrapper
+
+#endif  // LOGRECORD_H
@@ -0,0 +1,219 @@
+/**
+ * @file mounttop.cc
+ * @brief Live view of in-flight and recently completed wrapper invocations.
+ *
+ * Usage: mounttop [-b] [-d seconds] [-n iterations]
+ *
+ * Reads the shared-memory slot table the wrappers maintain (see slots.h), so
+ * it needs no access to the log and costs the wrappers nothing. -d sets the
+ * refresh interval (default 1s), -n stops after that many refreshes, and -b
+ * prints successive snapshots instead of redrawing the screen.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "shm.h"
+#include "slots.h"
+
+using namespace mountwrapper;
+
+namespace {
+
+const char* PhaseName(uint32_t phase) {
+    switch (phase) {
+        case kPhaseSpawning:
+            return "spawning";
+        case kPhaseRunning:
+            return "running";
+        case kPhaseLogging:
+            return "logging";
+        default:
+            return "?";
+    }
+}
+
+std::string FormatDuration(int64_t ns) {
+    std::ostringstream ss;
+    ss << std::fixed;
+    if (ns < 1000000) {
+        ss << std::setprecision(0) << ns / 1e3 << "us";
+    } else if (ns < 1000000000) {
+        ss << std::setprecision(1) << ns / 1e6 << "ms";
+    } else {
+        ss << std::setprecision(2) << ns / 1e9 << "s";
+    }
+    return ss.str();
+}
+
+std::string FormatStatus(int32_t status) {
+    if (status < 0) {
+        return "sig " + std::to_string(-status);
+    }
+    if (status == 128) {
+        return "execv";
+    }
+    return "exit " + std::to_string(status);
+}
+
+size_t TerminalWidth() {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) {
+        return ws.ws_col;
+    }
+    return std::string::npos;
+}
+
+void PrintLine(const std::string& line, size_t width) {
+    std::cout << line.substr(0, width) << "\n";
+}
+
+void Snapshot(const SlotTable* table, bool batch) {
+    size_t width = TerminalWidth();
+    int64_t now = MonotonicNs();
+
+    struct Inflight {
+        SlotData data;
+        uint32_t phase;
+    };
+    std::vector<Inflight> inflight;
+    for (const auto& slot : table->inflight) {
+        Inflight entry;
+        if (ReadSlot(slot, entry.data, entry.phase)) {
+            inflight.push_back(entry);
+        }
+    }
+    // Longest-running first.
+    std::sort(inflight.begin(), inflight.end(),
+              [](const Inflight& a, const Inflight& b) {
+                  return a.data.start_ns < b.data.start_ns;
+              });
+
+    uint64_t completions =
+        table->recent_next.load(std::memory_order_relaxed);
+
+    if (!batch) {
+        std::cout << "\033[H\033[2J";  // Home, clear screen.
+    }
+    time_t wall = time(nullptr);
+    char when[32];
+    strftime(when, sizeof(when), "%H:%M:%S", localtime(&wall));
+    std::ostringstream ss;
+    ss << "mounttop - " << when << "  in flight: " << inflight.size()
+       << "  completions: " << completions;
+    PrintLine(ss.str(), width);
+    PrintLine("", width);
+
+    ss = {};
+    ss << std::setw(8) << "PID" << std::setw(8) << "CHILD" << "  "
+       << std::left << std::setw(9) << "PHASE" << std::right
+       << std::setw(9) << "ELAPSED" << "  COMMAND";
+    PrintLine(ss.str(), width);
+    for (const auto& e : inflight) {
+        ss = {};
+        ss << std::setw(8) << e.data.wrapper_pid << std::setw(8)
+           << (e.data.child_pid > 0 ? std::to_string(e.data.child_pid)
+                                    : "-")
+           << "  " << std::left << std::setw(9) << PhaseName(e.phase)
+           << std::right << std::setw(9)
+           << FormatDuration(now - e.data.start_ns) << "  "
+           << e.data.binary << " " << e.data.args;
+        // A wrapper killed mid-run leaves its slot behind until reused.
+        if (kill(e.data.wrapper_pid, 0) == -1 && errno == ESRCH) {
+            ss << " (dead)";
+        }
+        PrintLine(ss.str(), width);
+    }
+
+    PrintLine("", width);
+    ss = {};
+    ss << std::setw(9) << "AGO" << std::setw(9) << "LATENCY" << "  "
+       << std::left << std::setw(8) << "STATUS" << std::right
+       << "  COMMAND";
+    PrintLine(ss.str(), width);
+    // Newest first.
+    uint64_t count = std::min<uint64_t>(completions, kRecentSlots);
+    for (uint64_t n = 1; n <= count; n++) {
+        const auto& slot = table->recent[(completions - n) % kRecentSlots];
+        SlotData data;
+        uint32_t phase;
+        if (!ReadSlot(slot, data, phase)) {
+            continue;
+        }
+        ss = {};
+        ss << std::setw(9) << FormatDuration(now - data.end_ns)
+           << std::setw(9) << FormatDuration(data.end_ns - data.start_ns)
+           << "  " << std::left << std::setw(8) << FormatStatus(data.status)
+           << std::right << "  " << data.binary << " " << data.args;
+        PrintLine(ss.str(), width);
+    }
+    if (batch) {
+        PrintLine("", width);
+    }
+    std::cout.flush();
+}
+
+[[noreturn]] void Usage(const char* progname) {
+    std::cerr << "Usage: " << progname
+              << " [-b] [-d seconds] [-n iterations]\n";
+    exit(EXIT_FAILURE);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    double interval = 1.0;
+    long iterations = -1;
+    bool batch = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "bd:n:")) != -1) {
+        switch (opt) {
+            case 'b':
+                batch = true;
+                break;
+            case 'd':
+                interval = strtod(optarg, nullptr);
+                if (interval <= 0) {
+                    Usage(argv[0]);
+                }
+                break;
+            case 'n':
+                iterations = strtol(optarg, nullptr, 10);
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+
+    auto table = static_cast<const SlotTable*>(
+        MapSharedBlockReadOnly(kSlotsBlockName, sizeof(SlotTable)));
+    if (table == nullptr) {
+        std::cerr << argv[0] << ": no slot table (" << kSlotsBlockName
+                  << "); has a wrapper run on this node?\n";
+        exit(EXIT_FAILURE);
+    }
+
+    for (long n = 0; iterations < 0 || n < iterations; n++) {
+        if (n > 0) {
+            struct timespec ts;
+            ts.tv_sec = static_cast<time_t>(interval);
+            ts.tv_nsec = static_cast<long>((interval - ts.tv_sec) * 1e9);
+            nanosleep(&ts, nullptr);
+        }
+        Snapshot(table, batch);
+    }
+    return EXIT_SUCCESS;
+}
@@ -15,292 +15,518 @@
  * It's configured using the environment, because we want to leave the command
  * line completely untouched. Use WRAPPER_OUTPUT to change the log file
  * location, and WRAPPER_BINARY to change the target binary being wrapped.
+ * Every other WRAPPER_<NAME> variable is an option of libmountwrapper (see
+ * libmountwrapper.h), which does the capture, spawn, wait and logging so
+ * that other launchers can produce identical records in-process; this file
+ * is a thin client of it. The options fall into a few groups, each
+ * described in detail where it's implemented.
  *
- * We will leave our invocation environment untouched, but will execv(2) the
+ * Logging. Each run writes an execute and a completed record, carrying a
+ * time-ordered unique ID (also exported to the child as
+ * WRAPPER_INVOCATION_ID) and the exec-to-exit latency. WRAPPER_SHARDS
+ * spreads the log over several files, which mwmerge reassembles, and
+ * WRAPPER_MAX_FIELD_BYTES and WRAPPER_MAX_RECORD_BYTES cap what a record
+ * can hold (mwinternal.h). Records that can't be logged are spooled in
+ * memory until a later run can write them (spool.h).
+ *
+ * Statistics. Records can carry what the run cost and who asked for it: the
+ * wrapper's own overhead (mwinternal.h), the child's delay accounting
+ * (taskstats.h), NFS RPC counters (nfsstats.h), the I/O of the device
+ * being mounted (blockstats.h), how much of the binary was out of the page
+ * cache (residency.h), inherited descriptors (fds.h), the calling process
+ * (caller.h) and what was trimmed from the child's environment
+ * (envtrim.h). mwrollup, mwcol, mwcompare and mwoverhead analyse them.
+ *
+ * Shared memory. Runs on a node share a change-point detector on latency
+ * (detector.cc), a table of runs in flight for mounttop (slots.h), and
+ * optionally a flight recorder that keeps records out of the log until a
+ * run fails (flightrec.h).
+ *
+ * Tracing. A TRACEPARENT in the environment makes the run a child span,
+ * and WRAPPER_OTLP_OUTPUT exports the spans as OTLP/JSON (trace.cc).
+ *
+ * We will leave our invocation environment untouched, but will execve(2) the
  * wrapped binary. This means that the program will start with argv[0] equal
  * to the wrapper's path. This is intentional; some programs react differently
  * based on their invocation path name. (If the OS changes argv[0] to match
  * the binary name, there's nothing we can do.)
+ *
+ * Batch mode. If WRAPPER_BATCH is set to a file name (or "-" for stdin),
+ * the command line is ignored and each non-blank, non-comment line of the
+ * file is treated as the argument list (excluding argv[0]) of one
+ * invocation of the wrapped binary. Invocations are ordered by mountpoint,
+ * parents before children, and independent ones are run in parallel on up
+ * to WRAPPER_BATCH_JOBS workers (default: the number of CPUs). Each
+ * invocation is logged exactly as if it had been run on its own.
  */
 
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
 #include <cstdlib>
-#include <ctime>
+#include <deque>
 #include <filesystem>
-#include <iomanip>
+#include <fstream>
 #include <iostream>
-#include <map>
-#include <sstream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <system_error>
+#include <thread>
 #include <vector>
 
 #include <errno.h>
-#include <fcntl.h>
 #include <libgen.h>
 #include <string.h>
-#include <sys/wait.h>
-#include <time.h>
 #include <unistd.h>
 
-using namespace std::string_literals;
+#include "libmountwrapper.hh"
+#include "mwinternal.h"
 
 namespace fs = std::filesystem;
 
-static constexpr char kLogFileEnvVar[] = "WRAPPER_OUTPUT";
-static constexpr char kDefaultOutputFile[] =
-    "/var/lib/storageos/logs/mountwrapper.log";
+using mountwrapper::EnvStringWithDefault;
 
 static constexpr char kMountBinaryEnvVar[] = "WRAPPER_BINARY";
 static constexpr char kMountBinaryLocation[] = "/usr/bin/mount.real";
 
-static constexpr size_t kMaxEnvVarValueLength = 40;
+static constexpr char kBatchEnvVar[] = "WRAPPER_BATCH";
+static constexpr char kBatchJobsEnvVar[] = "WRAPPER_BATCH_JOBS";
 
-std::string logfile{};
 std::string progname{};
 
-std::string EnvStringWithDefault(const std::string& env,
-                                 const std::string& default_value) {
-    char* present = getenv(env.c_str());
-    if (present == nullptr || (std::string(present) == "")) {
-        return default_value;
-    }
-    return std::string(present);
-}
-
 [[noreturn]] void error_sys(int err, const std::string& message) {
     std::cerr << progname << " (wrapper): " << message << ": "
               << strerror(err) << "\n";
     exit(EXIT_FAILURE);
 }
 
-std::string GetNanoTimestring() {
-    struct timespec ts;
-    if (clock_gettime(CLOCK_REALTIME, &ts) == -1) {
-        error_sys(errno, "clock_gettime() failed");
+// Run the wrapped binary once with the given argument vector (including
+// argv[0]) and the process environment, logging it via libmountwrapper.
+// Returns the exit code to report for it.
+int RunInvocation(const std::string& binary,
+                  const std::vector<std::string>& arg) {
+    try {
+        mountwrapper::Invocation inv(binary, arg);
+        // Whoever exec'd us asked for the run, not this process.
+        inv.SetOption("caller_pid", std::to_string(getppid()));
+        try {
+            return inv.Run();
+        } catch (const std::system_error& e) {
+            if (inv.exit_code() == -1) {
+                throw;
+            }
+            // The binary has run, and how it went is what our caller
+            // needs to hear, whatever happened to the records.
+            std::cerr << progname << " (wrapper): " << e.what() << "\n";
+            return inv.exit_code();
+        }
+    } catch (const std::system_error& e) {
+        // what() already carries the error's description.
+        std::cerr << progname << " (wrapper): " << e.what() << "\n";
+        exit(EXIT_FAILURE);
     }
-    std::ostringstream ss;
-    ss << ts.tv_sec << "." << std::setfill('0') << std::setw(9)
-       << std::to_string(ts.tv_nsec);
-    return ss.str();
 }
 
-// Generate a timestamp of now (via clock_gettime()).
-std::string GetTimestamp() {
-    struct timespec ts;
-    if (clock_gettime(CLOCK_REALTIME, &ts) == -1) {
-        error_sys(errno, "clock_gettime() failed");
+//
+// Batch mode.
+//
+
+struct BatchJob {
+    size_t line;                     // Line number in the batch file.
+    std::vector<std::string> arg;    // Full argv, including argv[0].
+    std::string mountpoint;          // Normalised; empty if unknown.
+    std::vector<size_t> dependents;  // Jobs waiting on this one.
+    std::atomic<size_t> pending{0};  // Unfinished jobs we wait on.
+    std::atomic<bool> failed{false};  // This job, or a dependency, failed.
+    int exit_code = EXIT_SUCCESS;
+};
+
+// Split a batch line into words, honouring single quotes, double quotes and
+// backslash escapes much as sh(1) would. A '#' at the start of a word begins
+// a comment.
+bool SplitBatchLine(const std::string& line,
+                    std::vector<std::string>& words) {
+    std::string word;
+    bool in_word = false;
+    char quote = 0;
+    for (size_t n = 0; n < line.size(); n++) {
+        char c = line[n];
+        if (quote == '\'') {
+            if (c == '\'')
+                quote = 0;
+            else
+                word += c;
+        } else if (quote == '"') {
+            if (c == '"') {
+                quote = 0;
+            } else if (c == '\\' && n + 1 < line.size() &&
+                       strchr("\"\\$`", line[n + 1]) != nullptr) {
+                word += line[++n];
+            } else {
+                word += c;
+            }
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+            in_word = true;
+        } else if (c == '\\' && n + 1 < line.size()) {
+            word += line[++n];
+            in_word = true;
+        } else if (isspace(static_cast<unsigned char>(c))) {
+            if (in_word) {
+                words.push_back(word);
+                word.clear();
+                in_word = false;
+            }
+        } else if (c == '#' && !in_word) {
+            break;
+        } else {
+            word += c;
+            in_word = true;
+        }
     }
-    char ftime[64];
-    time_t tt = ts.tv_sec;
-    struct tm bdtime;
-
-    if (gmtime_r(&tt, &bdtime) == nullptr) {
-        error_sys(errno, "gmtime_r() failed");
+    if (quote != 0) {
+        return false;
     }
-
-    if (strftime(ftime, sizeof(ftime), "%Y-%m-%dT%H:%M:%S", &bdtime) == 0) {
-        error_sys(errno, "strftime() failed");
+    if (in_word) {
+        words.push_back(word);
     }
-    std::ostringstream ss;
-    // formatted_time dot microsec (==nsec / 1000).
-    ss << ftime << "." << std::setfill('0') << std::setw(6)
-       << ts.tv_nsec / 1000;
-
-    return ss.str();
+    return true;
 }
 
-// Turn the given string vector into a comma-separated string.
-std::string GetVecString(const std::vector<std::string>& vec) {
-    std::ostringstream ss;
-    bool first = true;
-    for (size_t n = 0; n < vec.size(); n++) {
-        if (first == true)
-            first = false;
-        else
-            ss << ",";
-        ss << "\"" << vec[n] << "\"";
+// Work out the mountpoint of a mount(8)-style argument list (excluding
+// argv[0]): the explicit --target, otherwise the last positional argument.
+// Returns an empty string if there isn't one (e.g. 'mount -a').
+std::string GuessMountpoint(const std::vector<std::string>& args) {
+    // Options whose value is the next argument.
+    static const std::vector<std::string> kValueOptions = {
+        "-t", "-o", "-O", "-L", "-U", "-T", "-N",
+        "--types", "--options", "--test-opts", "--label", "--uuid",
+        "--fstab", "--namespace", "--source", "--options-mode",
+        "--options-source", "--map-users", "--map-groups", "--onlyonce"};
+    std::vector<std::string> positional;
+    std::string target;
+    bool options_done = false;
+    for (size_t n = 0; n < args.size(); n++) {
+        const auto& a = args[n];
+        if (!options_done && a == "--") {
+            options_done = true;
+        } else if (!options_done && a == "--target" && n + 1 < args.size()) {
+            target = args[++n];
+        } else if (!options_done && a.rfind("--target=", 0) == 0) {
+            target = a.substr(strlen("--target="));
+        } else if (!options_done && a.size() > 1 && a[0] == '-') {
+            if (std::find(kValueOptions.begin(), kValueOptions.end(), a) !=
+                kValueOptions.end()) {
+                n++;
+            }
+        } else {
+            positional.push_back(a);
+        }
+    }
+    if (target.empty() && !positional.empty()) {
+        target = positional.back();
     }
-    return ss.str();
+    if (target.empty()) {
+        return target;
+    }
+    auto normal = fs::path{target}.lexically_normal().string();
+    while (normal.size() > 1 && normal.back() == '/') {
+        normal.pop_back();
+    }
+    return normal;
 }
 
-std::string GetMapString(const std::map<std::string, std::string>& map) {
-    std::ostringstream ss;
-    bool first = true;
-    for (const auto& kv : map) {
-        if (first == true)
-            first = false;
-        else
-            ss << ",";
-        ss << kv.first << "=" << kv.second;
+// True if 'parent' is a proper path-component prefix of 'child'.
+bool IsAncestorPath(const std::string& parent, const std::string& child) {
+    if (parent.size() >= child.size() ||
+        child.compare(0, parent.size(), parent) != 0) {
+        return false;
     }
-    return ss.str();
+    return parent.back() == '/' || child[parent.size()] == '/';
 }
 
-std::string CanonicaliseString(const std::string& input) {
-    std::string output{input};
-    if (output.size() > kMaxEnvVarValueLength) {
-        output = output.substr(0, kMaxEnvVarValueLength - 3) + "...";
-    }
-    for (size_t n = 0; n < output.size(); n++) {
-        if (output[n] < 32 || output[n] > 127)
-            output[n] = '.';
+// Read the batch file and build the job list, one job per invocation.
+std::vector<std::unique_ptr<BatchJob>> ReadBatch(const std::string& source,
+                                                 const std::string& argv0) {
+    std::ifstream file;
+    std::istream* in = &std::cin;
+    if (source != "-") {
+        file.open(source);
+        if (!file) {
+            error_sys(errno, "Failed to open batch file '" + source + "'");
+        }
+        in = &file;
     }
-    return output;
-}
 
-// Append an item to the given vector with a timestamp prepended.
-void Log(std::vector<std::string>& out, const std::string& str) {
-    out.emplace_back(GetTimestamp() + " " + str);
+    std::vector<std::unique_ptr<BatchJob>> jobs;
+    std::string line;
+    size_t lineno = 0;
+    while (std::getline(*in, line)) {
+        lineno++;
+        std::vector<std::string> words;
+        if (!SplitBatchLine(line, words)) {
+            std::cerr << progname << " (wrapper): " << source << ":"
+                      << lineno << ": unterminated quote\n";
+            exit(EXIT_FAILURE);
+        }
+        if (words.empty()) {
+            continue;
+        }
+        auto job = std::make_unique<BatchJob>();
+        job->line = lineno;
+        job->mountpoint = GuessMountpoint(words);
+        job->arg.push_back(argv0);
+        job->arg.insert(job->arg.end(), words.begin(), words.end());
+        jobs.push_back(std::move(job));
+    }
+    if (in->bad()) {
+        error_sys(errno, "Failed to read batch file '" + source + "'");
+    }
+    return jobs;
 }
 
-// If something goes wrong, dump what we have to stdout so it's not entirely
-// lost.
-void PanicDump(const std::vector<std::string>& output) {
-    for (const auto& line : output) {
-        std::cout << line << "\n";
+// Add the dependency edges for jobs [begin, end): a job waits for every job
+// mounting one of its ancestor directories, and for earlier jobs on the same
+// mountpoint (so over-mounts keep their file order).
+void BuildDependencies(std::vector<std::unique_ptr<BatchJob>>& jobs,
+                       size_t begin,
+                       size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        for (size_t j = begin; j < end; j++) {
+            const auto& mi = jobs[i]->mountpoint;
+            const auto& mj = jobs[j]->mountpoint;
+            if (i == j) {
+                continue;
+            }
+            if (IsAncestorPath(mj, mi) || (j < i && mj == mi)) {
+                jobs[j]->dependents.push_back(i);
+                jobs[i]->pending++;
+            }
+        }
     }
 }
 
-int main(int argc, char* argv[]) {
-    std::vector<std::string> output{};
-
-    logfile = EnvStringWithDefault(kLogFileEnvVar, kDefaultOutputFile);
-    std::string binary =
-        EnvStringWithDefault(kMountBinaryEnvVar, kMountBinaryLocation);
+// A small work-stealing pool. Each worker owns a deque; it pushes newly
+// runnable jobs on the back and pops from the back, and idle workers steal
+// from the front of other workers' deques.
+class BatchPool {
+   public:
+    BatchPool(std::vector<std::unique_ptr<BatchJob>>& jobs,
+              const std::string& binary,
+              size_t nworkers)
+        : jobs_(jobs),
+          binary_(binary),
+          caller_pid_(std::to_string(getppid())),
+          queues_(nworkers) {}
+
+    // Run the given jobs (which must have no pending dependencies) and
+    // everything that depends on them, returning once 'count' jobs are done.
+    void Run(const std::vector<size_t>& roots, size_t count) {
+        remaining_ = count;
+        for (size_t n = 0; n < roots.size(); n++) {
+            Push(n % queues_.size(), roots[n]);
+        }
+        std::vector<std::thread> workers;
+        for (size_t w = 0; w < queues_.size(); w++) {
+            workers.emplace_back([this, w] { Work(w); });
+        }
+        for (auto& t : workers) {
+            t.join();
+        }
+    }
 
-    // Set the program name for log messages.
-    progname = std::string(basename(argv[0]));
+   private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> jobs;
+    };
 
-    // Copy the arguments to a string vector that isn't a pain to use.
-    std::vector<std::string> arg;
-    for (int n = 0; n < argc; n++) {
-        arg.push_back(std::string(argv[n]));
+    void Push(size_t worker, size_t job) {
+        {
+            std::lock_guard<std::mutex> lock(queues_[worker].mutex);
+            queues_[worker].jobs.push_back(job);
+        }
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex_);
+            queued_++;
+        }
+        idle_cv_.notify_one();
     }
 
-    // Likewise copy the environment.
-    std::map<std::string, std::string> env;
-    for (char** ep = environ; *ep != nullptr; ep++) {
-        std::string kv{*ep};
-        auto pos = kv.find("=");
-        if (pos != kv.npos) {
-            std::string key = kv.substr(0, pos);
-            std::string value = kv.substr(pos + 1, kv.size());  // After '='.
-            value = CanonicaliseString(value);
-            env[key] = value;
+    bool Pop(size_t worker, size_t& job) {
+        // Own queue first, newest job first.
+        {
+            auto& q = queues_[worker];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (!q.jobs.empty()) {
+                job = q.jobs.back();
+                q.jobs.pop_back();
+                return true;
+            }
+        }
+        // Then steal the oldest job from someone else.
+        for (size_t n = 1; n < queues_.size(); n++) {
+            auto& q = queues_[(worker + n) % queues_.size()];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (!q.jobs.empty()) {
+                job = q.jobs.front();
+                q.jobs.pop_front();
+                return true;
+            }
         }
+        return false;
     }
 
-    // Prepare a string for the log file.
-    auto runtimestamp = GetNanoTimestring();
-    auto argstr = GetVecString(arg);
-    auto envstr = GetMapString(env);
-    std::ostringstream ss{};
-    ss << "runtimestamp " << runtimestamp << " execute '" << binary
-       << "' argv:[" << argstr << "] environment:[" << envstr << "]";
-    Log(output, ss.str());
-
-    //
-    // fork(), then exec() in the child.
-    //
-
-    int child_exit_code = EXIT_SUCCESS;
-    auto cpid = fork();
-    if (cpid == -1) {
-        error_sys(errno, "fork() failed");
-    }
-    if (cpid == 0) {
-        // In child. execv() the real mount binary, but do nothing with the
-        // output.
-        execv(binary.c_str(), argv);
-
-        // If we get here, the exec failed.
-        std::cerr << progname << " (wrapper): "
-                  << "execv() failed"
-                  << ": " << strerror(errno) << "\n";
-
-        // Exit status 128 isn't used by the mount command. We'll use it to
-        // indicate an execv() failure to the parent.
-        exit(128);
-
-    } else {
-        // In parent.
-        int wstatus;
-
-        int w = waitpid(cpid, &wstatus, 0);
-        if (w == -1) {
-            error_sys(errno, "waitpid() failed");
+    void Work(size_t worker) {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(idle_mutex_);
+                idle_cv_.wait(lock, [this] {
+                    return queued_ > 0 || remaining_ == 0;
+                });
+                if (queued_ == 0) {
+                    return;  // Everything is done.
+                }
+                queued_--;
+            }
+            size_t job;
+            // We reserved a queued job above, so one is guaranteed to be
+            // somewhere; we may just have to look twice if another worker
+            // stole 'ours' first.
+            while (!Pop(worker, job)) {
+                std::this_thread::yield();
+            }
+            Execute(worker, *jobs_[job]);
         }
-        std::ostringstream ss;
-        ss << "runtimestamp " << runtimestamp << " completed '" << binary
-           << "' args:[" << argstr << "]";
-        auto prefix = ss.str();
-        ss = {};
-        ss << prefix << " ";
-
-        if (WIFEXITED(wstatus)) {
-            int ec = WEXITSTATUS(wstatus);
-            if (ec == 128) {
-                ss << "failed to execv(2) (ec==128)";
+    }
+
+    void Execute(size_t worker, BatchJob& job) {
+        try {
+            mountwrapper::Invocation inv(binary_, job.arg);
+            // As in RunInvocation(): whoever started the batch asked for it.
+            inv.SetOption("caller_pid", caller_pid_);
+            if (job.failed) {
+                // A dependency failed. Don't mount on top of a missing
+                // parent, but leave a record so the gap is visible in the
+                // log.
+                inv.Skip("batch line " + std::to_string(job.line) +
+                         ": dependency failed");
+                inv.Flush();
+                job.exit_code = EXIT_FAILURE;
             } else {
-                ss << "exit with code " << ec;
+                job.exit_code = inv.Run();
             }
-            child_exit_code = ec;
+        } catch (const std::system_error& e) {
+            // Don't take the rest of the batch down with us.
+            std::cerr << progname << " (wrapper): batch line " << job.line
+                      << ": " << e.what() << "\n";
+            job.exit_code = EXIT_FAILURE;
+        }
+        if (job.exit_code != EXIT_SUCCESS) {
+            job.failed = true;
+        }
 
-        } else if (WIFSIGNALED(wstatus)) {
-            int sig = WTERMSIG(wstatus);
-            ss << "exit with signal " << sig;
-            child_exit_code = EXIT_FAILURE;
+        for (auto d : job.dependents) {
+            auto& dep = *jobs_[d];
+            if (job.failed) {
+                dep.failed = true;
+            }
+            if (--dep.pending == 0) {
+                Push(worker, d);
+            }
+        }
 
-        } else {
-            ss << "stopped with unknown status " << wstatus;
-            child_exit_code = EXIT_FAILURE;
+        bool done;
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex_);
+            done = (--remaining_ == 0);
+        }
+        if (done) {
+            idle_cv_.notify_all();
         }
-        Log(output, ss.str());
     }
 
-    // Dump all regular output to the log file. Open the log file only after
-    // all the raceable stuff has taken place, so we don't influence the
-    // result.
-    //
-    // 'Regular output' means the wrapped program was successfully exec'd, but
-    // doesn't necessarily mean it returned with a zero exit code.
-
-    std::error_code ec;
-    auto logdir = fs::path{logfile}.parent_path();
-
-    // fs::create_directories() returns failure if the directory already
-    // existed, so check the error code as well.
-
-    if (!fs::create_directories(logdir, ec) && ec) {
-        std::cerr << "Failed to create log directory " << logdir
-                  << ", will log to stdout: " << strerror(errno) << "\n";
-
-        PanicDump(output);
-        // Still want to clean up and exit with the child's exit code.
-
-    } else {
-        // Use stdio.h so it's clear that we're using specific open flags.
-        int logfd =
-            open(logfile.c_str(), O_CREAT | O_WRONLY | O_APPEND, 0644);
-        if (logfd == -1) {
-            PanicDump(output);
-            error_sys(errno, "Failed to open log file");
+    std::vector<std::unique_ptr<BatchJob>>& jobs_;
+    const std::string& binary_;
+    const std::string caller_pid_;  // Taken once, in case it exits.
+    std::vector<Queue> queues_;
+
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
+    size_t queued_ = 0;     // Jobs pushed but not yet claimed.
+    size_t remaining_ = 0;  // Jobs not yet finished.
+};
+
+// Run every invocation in the batch file, returning EXIT_SUCCESS if all of
+// them succeeded, otherwise the exit code of the first failure in file
+// order.
+int RunBatch(const std::string& source,
+             const std::string& binary,
+             const std::string& argv0) {
+    auto jobs = ReadBatch(source, argv0);
+
+    size_t nworkers = std::thread::hardware_concurrency();
+    auto jobs_env = EnvStringWithDefault(kBatchJobsEnvVar, "");
+    if (jobs_env != "") {
+        nworkers = strtoul(jobs_env.c_str(), nullptr, 10);
+    }
+    nworkers = std::max<size_t>(1, std::min(nworkers, jobs.size()));
+
+    // Invocations without an identifiable mountpoint (e.g. 'mount -a') could
+    // touch anything, so they act as barriers: everything before them
+    // finishes first, and everything after waits for them.
+    size_t begin = 0;
+    while (begin < jobs.size()) {
+        size_t end = begin;
+        if (jobs[begin]->mountpoint.empty()) {
+            end = begin + 1;
+        } else {
+            while (end < jobs.size() && !jobs[end]->mountpoint.empty()) {
+                end++;
+            }
         }
 
-        for (const auto& line : output) {
-            auto ret = write(logfd, line.c_str(), line.size());
-            if (ret != static_cast<ssize_t>(line.size())) {
-                PanicDump(output);
-                error_sys(errno, "Failed to write to log file");
-            }
-            ret = write(logfd, "\n", 1);
-            if (ret != 1) {
-                PanicDump(output);
-                error_sys(errno, "Failed to write to log file");
+        BuildDependencies(jobs, begin, end);
+        std::vector<size_t> roots;
+        for (size_t n = begin; n < end; n++) {
+            if (jobs[n]->pending == 0) {
+                roots.push_back(n);
             }
         }
-        (void)close(logfd);
+        BatchPool pool(jobs, binary, std::min(nworkers, end - begin));
+        pool.Run(roots, end - begin);
+        begin = end;
+    }
+
+    for (const auto& job : jobs) {
+        if (job->exit_code != EXIT_SUCCESS) {
+            return job->exit_code;
+        }
     }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+    std::string binary =
+        EnvStringWithDefault(kMountBinaryEnvVar, kMountBinaryLocation);
+    std::string batch = EnvStringWithDefault(kBatchEnvVar, "");
 
-    return child_exit_code;
+    // Set the program name for log messages.
+    progname = std::string(basename(argv[0]));
+
+    // Copy the arguments to a string vector that isn't a pain to use.
+    std::vector<std::string> arg;
+    for (int n = 0; n < argc; n++) {
+        arg.push_back(std::string(argv[n]));
+    }
+
+    if (batch != "") {
+        // Don't let the batch setting leak into the children, in case the
+        // wrapped binary is itself wrapped.
+        unsetenv(kBatchEnvVar);
+        return RunBatch(batch, binary, arg[0]);
+    }
+    return RunInvocation(binary, arg);
 }
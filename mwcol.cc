@@ -0,0 +1,732 @@
+/**
+ * @file mwcol.cc
+ * @brief Columnar archive of wrapper logs, and a predicate scanner for it.
+ *
+ * Usage: mwcol convert [-r rows] archive [log...]
+ *        mwcol scan [-s start] [-e end] [-b binary] [-c caller] [-x status]
+ *                   [-F] [-g hour|day|week] archive...
+ *        mwcol info archive...
+ *
+ * convert turns the completed records of wrapper logs (stdin if none are
+ * given) into an archive with one row per run. Rows are stored in row groups
+ * (default 65536 rows, sorted by time within each group; feed it mwmerge
+ * output for the best time-range skipping) as separate column chunks:
+ *
+ *   time     runtimestamp, delta-encoded zigzag varints
+ *   latency  exec-to-exit latency in ns, varints
+ *   binary   dictionary ids, varints
+ *   args     dictionary ids, varints
+ *   status   dictionary ids (of exit code, 128 for execve(), -signal)
+ *   caller   dictionary ids (of the caller's name, or empty)
+ *
+ * The footer holds the dictionaries and, for every column chunk, its offset,
+ * length, min and max, and a 64-bit presence mask of (value mod 64) so that
+ * equality predicates on dictionary columns can rule chunks out too.
+ *
+ * scan evaluates the predicates against the footer statistics first and
+ * only reads and decodes the column chunks of row groups that might match.
+ * Times are Unix seconds or %Y-%m-%dT%H:%M:%S (UTC). -c matches a caller,
+ * -x an exact status and -F any failure. Matching rows are printed (with
+ * the caller last, or '-'), or with -g, counted per period with their
+ * failure rate.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logrecord.h"
+#include "varint.h"
+
+using mountwrapper::LogRecord;
+using mountwrapper::PutString;
+using mountwrapper::PutVarint;
+using mountwrapper::UnZigZag;
+using mountwrapper::ZigZag;
+
+namespace {
+
+constexpr char kMagic[8] = {'M', 'W', 'C', 'O', 'L', '\x01', '\0', '\0'};
+constexpr char kTrailerMagic[8] = {'M', 'W', 'C', 'O', 'L', 'E', 'N', 'D'};
+constexpr uint64_t kFormatVersion = 1;
+constexpr size_t kDefaultGroupRows = 65536;
+
+enum Column { kTime, kLatency, kBinary, kArgs, kStatus, kCaller, kColumns };
+constexpr bool kIsDictionary[kColumns] = {false, false, true,
+                                          true,  true,  true};
+constexpr const char* kColumnNames[kColumns] = {
+    "time", "latency", "binary", "args", "status", "caller"};
+
+const char* progname = "mwcol";
+
+[[noreturn]] void Fatal(const std::string& message) {
+    std::cerr << progname << ": " << message << "\n";
+    exit(EXIT_FAILURE);
+}
+
+// Reads from an archive buffer, giving up on the archive if it's corrupt.
+class Reader {
+   public:
+    Reader(const char* data, size_t size) : r_(data, size) {}
+
+    uint64_t Varint() {
+        uint64_t v;
+        if (!r_.Varint(v)) {
+            Fatal("archive is truncated or corrupt");
+        }
+        return v;
+    }
+
+    std::string String() {
+        std::string str;
+        if (!r_.String(str)) {
+            Fatal("archive is truncated or corrupt");
+        }
+        return str;
+    }
+
+   private:
+    mountwrapper::VarintReader r_;
+};
+
+//
+// Archive metadata.
+//
+
+struct ChunkMeta {
+    uint64_t offset = 0;
+    uint64_t length = 0;
+    int64_t min = INT64_MAX;
+    int64_t max = INT64_MIN;
+    uint64_t presence = 0;  // Bit (value mod 64) set for each value.
+
+    void Add(int64_t v) {
+        min = std::min(min, v);
+        max = std::max(max, v);
+        presence |= 1ULL << (static_cast<uint64_t>(v) % 64);
+    }
+    bool MayContain(int64_t v) const {
+        return v >= min && v <= max &&
+               (presence & (1ULL << (static_cast<uint64_t>(v) % 64)));
+    }
+};
+
+struct GroupMeta {
+    uint64_t rows = 0;
+    ChunkMeta chunks[kColumns];
+};
+
+struct Footer {
+    std::vector<std::string> dicts[kColumns];
+    std::vector<GroupMeta> groups;
+};
+
+//
+// convert
+//
+
+struct Row {
+    int64_t values[kColumns];
+};
+
+class Writer {
+   public:
+    Writer(const std::string& path, size_t group_rows)
+        : path_(path), out_(path, std::ios::binary | std::ios::trunc),
+          group_rows_(group_rows) {
+        if (!out_) {
+            Fatal(path + ": " + strerror(errno));
+        }
+        out_.write(kMagic, sizeof(kMagic));
+        offset_ = sizeof(kMagic);
+    }
+
+    void Add(const LogRecord& rec) {
+        Row row;
+        row.values[kTime] = rec.runtimestamp_ns;
+        row.values[kLatency] = rec.latency_ns;
+        row.values[kBinary] = Intern(kBinary, rec.binary);
+        row.values[kArgs] = Intern(kArgs, rec.args);
+        row.values[kStatus] = Intern(kStatus, std::to_string(rec.status));
+        row.values[kCaller] = Intern(kCaller, rec.caller);
+        rows_.push_back(row);
+        if (rows_.size() == group_rows_) {
+            FlushGroup();
+        }
+    }
+
+    uint64_t Finish() {
+        FlushGroup();
+
+        std::string footer;
+        PutVarint(footer, kFormatVersion);
+        PutVarint(footer, kColumns);
+        for (int c = 0; c < kColumns; c++) {
+            if (kIsDictionary[c]) {
+                PutVarint(footer, footer_.dicts[c].size());
+                for (const auto& s : footer_.dicts[c]) {
+                    PutString(footer, s);
+                }
+            }
+        }
+        PutVarint(footer, footer_.groups.size());
+        uint64_t total = 0;
+        for (const auto& g : footer_.groups) {
+            PutVarint(footer, g.rows);
+            total += g.rows;
+            for (const auto& chunk : g.chunks) {
+                PutVarint(footer, chunk.offset);
+                PutVarint(footer, chunk.length);
+                PutVarint(footer, ZigZag(chunk.min));
+                PutVarint(footer, ZigZag(chunk.max));
+                PutVarint(footer, chunk.presence);
+            }
+        }
+        out_.write(footer.data(), footer.size());
+        uint64_t length = footer.size();
+        char trailer[8];
+        for (int n = 0; n < 8; n++) {
+            trailer[n] = static_cast<char>(length >> (8 * n));
+        }
+        out_.write(trailer, sizeof(trailer));
+        out_.write(kTrailerMagic, sizeof(kTrailerMagic));
+        out_.close();
+        if (!out_) {
+            Fatal(path_ + ": write failed");
+        }
+        return total;
+    }
+
+   private:
+    int64_t Intern(Column c, const std::string& value) {
+        auto [it, inserted] =
+            ids_[c].emplace(value, footer_.dicts[c].size());
+        if (inserted) {
+            footer_.dicts[c].push_back(value);
+        }
+        return it->second;
+    }
+
+    void FlushGroup() {
+        if (rows_.empty()) {
+            return;
+        }
+        std::stable_sort(rows_.begin(), rows_.end(),
+                         [](const Row& a, const Row& b) {
+                             return a.values[kTime] < b.values[kTime];
+                         });
+        GroupMeta group;
+        group.rows = rows_.size();
+        for (int c = 0; c < kColumns; c++) {
+            std::string data;
+            int64_t prev = 0;
+            auto& chunk = group.chunks[c];
+            for (const auto& row : rows_) {
+                int64_t v = row.values[c];
+                chunk.Add(v);
+                if (c == kTime) {
+                    PutVarint(data, ZigZag(v - prev));
+                    prev = v;
+                } else {
+                    PutVarint(data, ZigZag(v));
+                }
+            }
+            chunk.offset = offset_;
+            chunk.length = data.size();
+            out_.write(data.data(), data.size());
+            offset_ += data.size();
+        }
+        footer_.groups.push_back(group);
+        rows_.clear();
+    }
+
+    std::string path_;
+    std::ofstream out_;
+    size_t group_rows_;
+    uint64_t offset_ = 0;
+    std::vector<Row> rows_;
+    std::unordered_map<std::string, int64_t> ids_[kColumns];
+    Footer footer_;
+};
+
+void ConvertStream(std::istream& in, Writer& writer, uint64_t& skipped) {
+    std::string line;
+    LogRecord rec;
+    while (std::getline(in, line)) {
+        if (!mountwrapper::ParseLogRecord(line, rec) ||
+            rec.kind != "completed") {
+            continue;
+        }
+        if (!rec.has_status) {
+            skipped++;
+            continue;
+        }
+        writer.Add(rec);
+    }
+}
+
+int Convert(int argc, char* argv[]) {
+    size_t group_rows = kDefaultGroupRows;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:")) != -1) {
+        switch (opt) {
+            case 'r':
+                group_rows = strtoul(optarg, nullptr, 10);
+                if (group_rows == 0) {
+                    Fatal("bad row group size");
+                }
+                break;
+            default:
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind == argc) {
+        Fatal("convert: no archive named");
+    }
+    Writer writer(argv[optind++], group_rows);
+    uint64_t skipped = 0;
+    if (optind == argc) {
+        ConvertStream(std::cin, writer, skipped);
+    }
+    for (int n = optind; n < argc; n++) {
+        std::ifstream in(argv[n]);
+        if (!in) {
+            Fatal(std::string(argv[n]) + ": " + strerror(errno));
+        }
+        ConvertStream(in, writer, skipped);
+    }
+    uint64_t rows = writer.Finish();
+    std::cerr << progname << ": wrote " << rows << " rows";
+    if (skipped != 0) {
+        std::cerr << ", skipped " << skipped << " unparseable records";
+    }
+    std::cerr << "\n";
+    return EXIT_SUCCESS;
+}
+
+//
+// Reading archives.
+//
+
+class Archive {
+   public:
+    explicit Archive(const std::string& path) : path_(path) {
+        fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ == -1) {
+            Fatal(path + ": " + strerror(errno));
+        }
+        struct stat st;
+        if (fstat(fd_, &st) == -1) {
+            Fatal(path + ": " + strerror(errno));
+        }
+        uint64_t size = st.st_size;
+        char head[8];
+        char trailer[16];
+        if (size < sizeof(kMagic) + sizeof(trailer) ||
+            !ReadAt(head, sizeof(head), 0) ||
+            memcmp(head, kMagic, sizeof(kMagic)) != 0 ||
+            !ReadAt(trailer, sizeof(trailer), size - sizeof(trailer)) ||
+            memcmp(trailer + 8, kTrailerMagic, sizeof(kTrailerMagic)) != 0) {
+            Fatal(path + ": not an mwcol archive");
+        }
+        uint64_t length = 0;
+        for (int n = 0; n < 8; n++) {
+            length |= static_cast<uint64_t>(static_cast<uint8_t>(trailer[n]))
+                      << (8 * n);
+        }
+        if (length > size - sizeof(kMagic) - sizeof(trailer)) {
+            Fatal(path + ": bad footer length");
+        }
+        std::string footer(length, '\0');
+        if (!ReadAt(&footer[0], length, size - sizeof(trailer) - length)) {
+            Fatal(path + ": can't read footer");
+        }
+        ParseFooter(footer, size - sizeof(trailer) - length);
+    }
+
+    ~Archive() { (void)close(fd_); }
+
+    const Footer& footer() const { return footer_; }
+    const std::string& path() const { return path_; }
+
+    // Decode one column chunk into values.
+    std::vector<int64_t> ReadChunk(const GroupMeta& group, Column c) const {
+        const auto& chunk = group.chunks[c];
+        std::string data(chunk.length, '\0');
+        if (!ReadAt(&data[0], chunk.length, chunk.offset)) {
+            Fatal(path_ + ": can't read column chunk");
+        }
+        // Every value takes at least a byte, and a dictionary column's
+        // values index its dictionary.
+        if (group.rows > chunk.length) {
+            Fatal(path_ + ": corrupt archive");
+        }
+        Reader r(data.data(), data.size());
+        std::vector<int64_t> values(group.rows);
+        int64_t prev = 0;
+        for (auto& v : values) {
+            v = UnZigZag(r.Varint());
+            if (c == kTime) {
+                v += prev;
+                prev = v;
+            } else if (kIsDictionary[c] &&
+                       (v < 0 || static_cast<uint64_t>(v) >=
+                                     footer_.dicts[c].size())) {
+                Fatal(path_ + ": corrupt archive");
+            }
+        }
+        return values;
+    }
+
+   private:
+    bool ReadAt(char* buf, size_t len, uint64_t offset) const {
+        while (len > 0) {
+            ssize_t n = pread(fd_, buf, len, offset);
+            if (n <= 0) {
+                return false;
+            }
+            buf += n;
+            len -= n;
+            offset += n;
+        }
+        return true;
+    }
+
+    // Parse the footer of an archive whose column chunks end at
+    // 'chunks_end', where the footer starts.
+    void ParseFooter(const std::string& data, uint64_t chunks_end) {
+        Reader r(data.data(), data.size());
+        uint64_t version = r.Varint();
+        uint64_t columns = r.Varint();
+        if (version != kFormatVersion || columns != kColumns) {
+            Fatal(path_ + ": unsupported archive version");
+        }
+        for (uint64_t c = 0; c < kColumns; c++) {
+            if (kIsDictionary[c]) {
+                uint64_t count = r.Varint();
+                for (uint64_t n = 0; n < count; n++) {
+                    footer_.dicts[c].push_back(r.String());
+                }
+            }
+        }
+        uint64_t ngroups = r.Varint();
+        for (uint64_t g = 0; g < ngroups; g++) {
+            GroupMeta group;
+            group.rows = r.Varint();
+            for (uint64_t c = 0; c < kColumns; c++) {
+                auto& chunk = group.chunks[c];
+                chunk.offset = r.Varint();
+                chunk.length = r.Varint();
+                chunk.min = UnZigZag(r.Varint());
+                chunk.max = UnZigZag(r.Varint());
+                chunk.presence = r.Varint();
+                // Check before ReadChunk() allocates for it.
+                if (chunk.offset < sizeof(kMagic) ||
+                    chunk.offset > chunks_end ||
+                    chunk.length > chunks_end - chunk.offset) {
+                    Fatal(path_ + ": corrupt archive");
+                }
+            }
+            footer_.groups.push_back(group);
+        }
+    }
+
+    std::string path_;
+    int fd_ = -1;
+    Footer footer_;
+};
+
+//
+// scan
+//
+
+struct Predicate {
+    int64_t start = INT64_MIN;
+    int64_t end = INT64_MAX;
+    std::string binary;
+    bool has_binary = false;
+    std::string caller;
+    bool has_caller = false;
+    std::string status;
+    bool has_status = false;
+    bool failures = false;
+};
+
+int64_t ParseTime(const char* str) {
+    if (strchr(str, 'T') != nullptr) {
+        struct tm bdtime;
+        memset(&bdtime, 0, sizeof(bdtime));
+        const char* rest = strptime(str, "%Y-%m-%dT%H:%M:%S", &bdtime);
+        if (rest == nullptr || *rest != '\0') {
+            Fatal(std::string("bad time '") + str + "'");
+        }
+        return static_cast<int64_t>(timegm(&bdtime)) * 1000000000LL;
+    }
+    char* end;
+    double secs = strtod(str, &end);
+    if (*end != '\0') {
+        Fatal(std::string("bad time '") + str + "'");
+    }
+    return static_cast<int64_t>(secs * 1e9);
+}
+
+int64_t PeriodStart(int64_t ns, const std::string& period) {
+    constexpr int64_t kHour = 3600LL * 1000000000LL;
+    constexpr int64_t kDay = 24 * kHour;
+    // The epoch was a Thursday; shift so weeks start on Monday.
+    constexpr int64_t kMondayShift = 3 * kDay;
+    auto floor_div = [](int64_t a, int64_t b) {
+        return (a >= 0 ? a / b : (a - b + 1) / b) * b;
+    };
+    if (period == "hour") {
+        return floor_div(ns, kHour);
+    } else if (period == "day") {
+        return floor_div(ns, kDay);
+    }
+    return floor_div(ns + kMondayShift, 7 * kDay) - kMondayShift;
+}
+
+std::string FormatTime(int64_t ns, bool micros) {
+    time_t secs = ns >= 0 ? ns / 1000000000LL : (ns + 1) / 1000000000LL - 1;
+    struct tm bdtime;
+    gmtime_r(&secs, &bdtime);
+    char buf[64];
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &bdtime);
+    std::string out = buf;
+    if (micros) {
+        char frac[24];
+        snprintf(frac, sizeof(frac), ".%06d",
+                 static_cast<int>((ns - secs * 1000000000LL) / 1000));
+        out += frac;
+    }
+    return out;
+}
+
+// Find a dictionary entry's id, or -1.
+int64_t Lookup(const std::vector<std::string>& dict,
+               const std::string& value) {
+    auto it = std::find(dict.begin(), dict.end(), value);
+    return it == dict.end() ? -1 : it - dict.begin();
+}
+
+int Scan(int argc, char* argv[]) {
+    Predicate pred;
+    std::string group_by;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:e:b:c:x:Fg:")) != -1) {
+        switch (opt) {
+            case 's':
+                pred.start = ParseTime(optarg);
+                break;
+            case 'e':
+                pred.end = ParseTime(optarg);
+                break;
+            case 'b':
+                pred.binary = optarg;
+                pred.has_binary = true;
+                break;
+            case 'c':
+                pred.caller = optarg;
+                pred.has_caller = true;
+                break;
+            case 'x':
+                pred.status = optarg;
+                pred.has_status = true;
+                break;
+            case 'F':
+                pred.failures = true;
+                break;
+            case 'g':
+                group_by = optarg;
+                if (group_by != "hour" && group_by != "day" &&
+                    group_by != "week") {
+                    Fatal("-g takes hour, day or week");
+                }
+                break;
+            default:
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind == argc) {
+        Fatal("scan: no archive named");
+    }
+
+    struct Bucket {
+        uint64_t count = 0;
+        uint64_t failures = 0;
+    };
+    std::map<int64_t, Bucket> buckets;
+    uint64_t groups_total = 0;
+    uint64_t groups_read = 0;
+
+    for (int n = optind; n < argc; n++) {
+        Archive archive(argv[n]);
+        const auto& footer = archive.footer();
+        int64_t binary_id = pred.has_binary
+                                ? Lookup(footer.dicts[kBinary], pred.binary)
+                                : -1;
+        int64_t caller_id = pred.has_caller
+                                ? Lookup(footer.dicts[kCaller], pred.caller)
+                                : -1;
+        int64_t status_id = pred.has_status
+                                ? Lookup(footer.dicts[kStatus], pred.status)
+                                : -1;
+        int64_t ok_id = Lookup(footer.dicts[kStatus], "0");
+        if ((pred.has_binary && binary_id == -1) ||
+            (pred.has_caller && caller_id == -1) ||
+            (pred.has_status && status_id == -1)) {
+            groups_total += footer.groups.size();
+            continue;  // The value never occurs in this archive.
+        }
+
+        for (const auto& group : footer.groups) {
+            groups_total++;
+            const auto& time = group.chunks[kTime];
+            const auto& status = group.chunks[kStatus];
+            if (time.max < pred.start || time.min >= pred.end ||
+                (pred.has_binary &&
+                 !group.chunks[kBinary].MayContain(binary_id)) ||
+                (pred.has_caller &&
+                 !group.chunks[kCaller].MayContain(caller_id)) ||
+                (pred.has_status && !status.MayContain(status_id)) ||
+                (pred.failures && status.min == ok_id &&
+                 status.max == ok_id)) {
+                continue;
+            }
+            groups_read++;
+
+            // Only decode the columns we need.
+            auto times = archive.ReadChunk(group, kTime);
+            auto statuses = archive.ReadChunk(group, kStatus);
+            std::vector<int64_t> binaries;
+            if (pred.has_binary || group_by.empty()) {
+                binaries = archive.ReadChunk(group, kBinary);
+            }
+            std::vector<int64_t> callers;
+            if (pred.has_caller || group_by.empty()) {
+                callers = archive.ReadChunk(group, kCaller);
+            }
+            std::vector<int64_t> latencies;
+            std::vector<int64_t> args;
+            if (group_by.empty()) {
+                latencies = archive.ReadChunk(group, kLatency);
+                args = archive.ReadChunk(group, kArgs);
+            }
+
+            for (size_t r = 0; r < group.rows; r++) {
+                if (times[r] < pred.start || times[r] >= pred.end ||
+                    (pred.has_binary && binaries[r] != binary_id) ||
+                    (pred.has_caller && callers[r] != caller_id) ||
+                    (pred.has_status && statuses[r] != status_id) ||
+                    (pred.failures && statuses[r] == ok_id)) {
+                    continue;
+                }
+                const auto& status_str = footer.dicts[kStatus][statuses[r]];
+                if (!group_by.empty()) {
+                    auto& b = buckets[PeriodStart(times[r], group_by)];
+                    b.count++;
+                    if (statuses[r] != ok_id) {
+                        b.failures++;
+                    }
+                    continue;
+                }
+                std::cout << FormatTime(times[r], true) << " " << status_str
+                          << " " << latencies[r] << " "
+                          << footer.dicts[kBinary][binaries[r]] << " ["
+                          << footer.dicts[kArgs][args[r]] << "] ";
+                const auto& caller_str = footer.dicts[kCaller][callers[r]];
+                std::cout << (caller_str.empty() ? "-" : caller_str) << "\n";
+            }
+        }
+    }
+
+    for (const auto& [start, b] : buckets) {
+        std::cout << FormatTime(start, false) << " " << b.count << " "
+                  << b.failures << " " << std::fixed << std::setprecision(4)
+                  << static_cast<double>(b.failures) / b.count << "\n";
+    }
+    std::cout.flush();
+    std::cerr << progname << ": read " << groups_read << " of "
+              << groups_total << " row groups\n";
+    return EXIT_SUCCESS;
+}
+
+int Info(int argc, char* argv[]) {
+    for (int n = 1; n < argc; n++) {
+        Archive archive(argv[n]);
+        const auto& footer = archive.footer();
+        uint64_t rows = 0;
+        uint64_t bytes[kColumns] = {};
+        for (const auto& g : footer.groups) {
+            rows += g.rows;
+            for (int c = 0; c < kColumns; c++) {
+                bytes[c] += g.chunks[c].length;
+            }
+        }
+        std::cout << archive.path() << ": " << rows << " rows in "
+                  << footer.groups.size() << " row groups\n";
+        for (int c = 0; c < kColumns; c++) {
+            std::cout << "  " << std::left << std::setw(8) << kColumnNames[c]
+                      << std::right << std::setw(12) << bytes[c] << " bytes";
+            if (kIsDictionary[c]) {
+                std::cout << ", " << footer.dicts[c].size()
+                          << " distinct values";
+            }
+            std::cout << "\n";
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+[[noreturn]] void Usage() {
+    std::cerr << "Usage: " << progname
+              << " convert [-r rows] archive [log...]\n"
+              << "       " << progname
+              << " scan [-s start] [-e end] [-b binary] [-c caller]\n"
+              << "                  [-x status] [-F] [-g hour|day|week] "
+                 "archive...\n"
+              << "       " << progname << " info archive...\n";
+    exit(EXIT_FAILURE);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    progname = argv[0];
+    if (argc < 2) {
+        Usage();
+    }
+    std::string command = argv[1];
+    // Let getopt() see the subcommand's arguments only.
+    argc--;
+    argv++;
+    int ret;
+    if (command == "convert") {
+        ret = Convert(argc, argv);
+    } else if (command == "scan") {
+        ret = Scan(argc, argv);
+    } else if (command == "info") {
+        ret = Info(argc, argv);
+    } else {
+        Usage();
+    }
+    if (ret != EXIT_SUCCESS) {
+        Usage();
+    }
+    return ret;
+}
@@ -0,0 +1,395 @@
+/**
+ * @file mwcompare.cc
+ * @brief Compare the latency of two sets of wrapper logs.
+ *
+ * Usage: mwcompare [-q quantiles] [-r resamples] [-c confidence] [-j jobs]
+ *                  [-s seed] [-f] [-C] base.log[,...] new.log[,...]
+ *
+ * For example, logs from before and after a kernel or mount.real upgrade.
+ * For each binary in both sets, the exec-to-exit latencies of its
+ * successful runs (all runs with -f) are compared in two ways (with -C,
+ * for each binary and caller in both sets):
+ *
+ * - For each quantile (-q, default 50,90,99), the new minus the base value
+ *   with a percentile bootstrap confidence interval (-r resamples, default
+ *   1000, at -c confidence, default 0.95). Intervals that exclude zero are
+ *   starred. Resamples are spread over -j threads (default all CPUs) and
+ *   each is seeded from -s and its index, so results don't depend on -j.
+ * - A two-sided Mann-Whitney U test of whether either set tends to be
+ *   slower, with the probability that a new run is slower than a base one.
+ *
+ * A binary is reported as slower or faster if the U test is significant at
+ * 1 - confidence, and exit status 2 says at least one binary got slower.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+
+#include "logrecord.h"
+
+using mountwrapper::LogRecord;
+
+namespace {
+
+constexpr int kExitRegression = 2;
+
+const char* progname = "mwcompare";
+
+[[noreturn]] void Fatal(const std::string& message) {
+    std::cerr << progname << ": " << message << "\n";
+    exit(EXIT_FAILURE);
+}
+
+std::vector<std::string> Split(const std::string& str, char sep) {
+    std::vector<std::string> parts;
+    std::istringstream ss(str);
+    std::string part;
+    while (std::getline(ss, part, sep)) {
+        parts.push_back(part);
+    }
+    return parts;
+}
+
+using Samples = std::map<std::string, std::vector<int64_t>>;
+
+// Reads the latencies of the completed runs in a comma-separated list of
+// logs, by binary, or by binary and caller.
+Samples ReadSet(const std::string& files, bool all, bool by_caller) {
+    Samples samples;
+    LogRecord rec;
+    for (const auto& file : Split(files, ',')) {
+        std::ifstream in(file);
+        if (!in) {
+            Fatal(file + ": " + strerror(errno));
+        }
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!mountwrapper::ParseLogRecord(line, rec) ||
+                rec.kind != "completed" || !rec.has_status ||
+                (!all && mountwrapper::StatusFailed(rec.status))) {
+                continue;
+            }
+            std::string key = rec.binary;
+            if (by_caller) {
+                key += " (caller " +
+                       (rec.caller.empty() ? "unknown" : rec.caller) + ")";
+            }
+            samples[key].push_back(rec.latency_ns);
+        }
+    }
+    for (auto& [binary, latencies] : samples) {
+        std::sort(latencies.begin(), latencies.end());
+    }
+    return samples;
+}
+
+size_t QuantileRank(double q, size_t n) {
+    return std::llround(q * (n - 1));
+}
+
+//
+// Mann-Whitney U.
+//
+
+struct UTest {
+    double superiority;  // P(new > base) + P(new == base) / 2.
+    double p;            // Two-sided, normal approximation.
+};
+
+UTest MannWhitney(const std::vector<int64_t>& base,
+                  const std::vector<int64_t>& next) {
+    double n1 = base.size();
+    double n2 = next.size();
+    double n = n1 + n2;
+    // Both are sorted, so merge them to rank the new values, averaging the
+    // ranks of ties and accumulating the tie correction as we go.
+    double rank_sum = 0;
+    double ties = 0;
+    size_t i = 0;
+    size_t j = 0;
+    double rank = 1;
+    while (i < base.size() || j < next.size()) {
+        int64_t v = j == next.size() || (i < base.size() && base[i] < next[j])
+                        ? base[i]
+                        : next[j];
+        size_t in_base = 0;
+        size_t in_next = 0;
+        while (i < base.size() && base[i] == v) {
+            i++;
+            in_base++;
+        }
+        while (j < next.size() && next[j] == v) {
+            j++;
+            in_next++;
+        }
+        double t = in_base + in_next;
+        rank_sum += in_next * (rank + (t - 1) / 2);
+        ties += t * t * t - t;
+        rank += t;
+    }
+    double u = rank_sum - n2 * (n2 + 1) / 2;
+    double mean = n1 * n2 / 2;
+    double var = n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)));
+    UTest result;
+    result.superiority = u / (n1 * n2);
+    if (var <= 0) {
+        result.p = 1;
+    } else {
+        // With a continuity correction.
+        double z = (std::fabs(u - mean) - 0.5) / std::sqrt(var);
+        result.p = std::min(1.0, std::erfc(std::max(z, 0.0) / std::sqrt(2)));
+    }
+    return result;
+}
+
+//
+// Bootstrap.
+//
+
+// Draws a resample of 'sorted' and returns its quantiles. Rather than
+// sorting the resample, count how often each position is drawn and walk the
+// counts, which is O(n) with no comparisons.
+void ResampleQuantiles(const std::vector<int64_t>& sorted,
+                       const std::vector<double>& quantiles,
+                       std::mt19937_64& rng,
+                       std::vector<uint32_t>& counts,
+                       std::vector<int64_t>& out) {
+    size_t n = sorted.size();
+    counts.assign(n, 0);
+    for (size_t k = 0; k < n; k++) {
+        counts[static_cast<unsigned __int128>(rng()) * n >> 64]++;
+    }
+    out.resize(quantiles.size());
+    size_t seen = 0;
+    size_t pos = 0;
+    for (size_t qi = 0; qi < quantiles.size(); qi++) {
+        size_t rank = QuantileRank(quantiles[qi], n);
+        while (seen + counts[pos] <= rank) {
+            seen += counts[pos++];
+        }
+        out[qi] = sorted[pos];
+    }
+}
+
+struct Interval {
+    double low;
+    double high;
+};
+
+// Percentile bootstrap intervals for the difference in each quantile.
+std::vector<Interval> Bootstrap(const std::vector<int64_t>& base,
+                                const std::vector<int64_t>& next,
+                                const std::vector<double>& quantiles,
+                                size_t resamples,
+                                double confidence,
+                                size_t jobs,
+                                uint64_t seed) {
+    // diffs[qi * resamples + r]
+    std::vector<double> diffs(quantiles.size() * resamples);
+    std::atomic<size_t> next_resample{0};
+    auto worker = [&]() {
+        std::vector<uint32_t> counts;
+        std::vector<int64_t> qbase, qnext;
+        size_t r;
+        while ((r = next_resample++) < resamples) {
+            std::seed_seq seq{seed, static_cast<uint64_t>(r)};
+            std::mt19937_64 rng(seq);
+            ResampleQuantiles(base, quantiles, rng, counts, qbase);
+            ResampleQuantiles(next, quantiles, rng, counts, qnext);
+            for (size_t qi = 0; qi < quantiles.size(); qi++) {
+                diffs[qi * resamples + r] =
+                    static_cast<double>(qnext[qi]) - qbase[qi];
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < std::min(jobs, resamples); t++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::vector<Interval> intervals;
+    double tail = (1 - confidence) / 2;
+    for (size_t qi = 0; qi < quantiles.size(); qi++) {
+        auto begin = diffs.begin() + qi * resamples;
+        auto end = begin + resamples;
+        std::sort(begin, end);
+        intervals.push_back({begin[QuantileRank(tail, resamples)],
+                             begin[QuantileRank(1 - tail, resamples)]});
+    }
+    return intervals;
+}
+
+//
+// Output.
+//
+
+std::string FormatDuration(double ns) {
+    std::ostringstream ss;
+    ss << std::fixed;
+    if (ns < 0) {
+        ss << "-";
+        ns = -ns;
+    }
+    if (ns < 1000000) {
+        ss << std::setprecision(0) << ns / 1e3 << "us";
+    } else if (ns < 1000000000) {
+        ss << std::setprecision(1) << ns / 1e6 << "ms";
+    } else {
+        ss << std::setprecision(2) << ns / 1e9 << "s";
+    }
+    return ss.str();
+}
+
+std::string FormatDiff(double ns) {
+    return (ns >= 0 ? "+" : "") + FormatDuration(ns);
+}
+
+std::string FormatQuantile(double q) {
+    std::ostringstream ss;
+    ss << "p" << q * 100;
+    return ss.str();
+}
+
+[[noreturn]] void Usage() {
+    std::cerr << "Usage: " << progname
+              << " [-q quantiles] [-r resamples] [-c confidence] [-j jobs]\n"
+              << "                 [-s seed] [-f] [-C] base.log[,...] "
+                 "new.log[,...]\n";
+    exit(EXIT_FAILURE);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    progname = argv[0];
+    std::vector<double> quantiles = {0.5, 0.9, 0.99};
+    size_t resamples = 1000;
+    double confidence = 0.95;
+    size_t jobs = std::max(1U, std::thread::hardware_concurrency());
+    uint64_t seed = 1;
+    bool all = false;
+    bool by_caller = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "q:r:c:j:s:fC")) != -1) {
+        switch (opt) {
+            case 'q':
+                quantiles.clear();
+                for (const auto& q : Split(optarg, ',')) {
+                    double pct = strtod(q.c_str(), nullptr);
+                    if (pct <= 0 || pct >= 100) {
+                        Usage();
+                    }
+                    quantiles.push_back(pct / 100);
+                }
+                std::sort(quantiles.begin(), quantiles.end());
+                break;
+            case 'r':
+                resamples = strtoul(optarg, nullptr, 10);
+                break;
+            case 'c':
+                confidence = strtod(optarg, nullptr);
+                break;
+            case 'j':
+                jobs = strtoul(optarg, nullptr, 10);
+                break;
+            case 's':
+                seed = strtoull(optarg, nullptr, 10);
+                break;
+            case 'f':
+                all = true;
+                break;
+            case 'C':
+                by_caller = true;
+                break;
+            default:
+                Usage();
+        }
+    }
+    if (optind + 2 != argc || quantiles.empty() || resamples < 10 ||
+        confidence <= 0 || confidence >= 1 || jobs == 0) {
+        Usage();
+    }
+
+    Samples base = ReadSet(argv[optind], all, by_caller);
+    Samples next = ReadSet(argv[optind + 1], all, by_caller);
+
+    int ret = EXIT_SUCCESS;
+    for (const auto& [binary, next_latencies] : next) {
+        auto it = base.find(binary);
+        if (it == base.end()) {
+            continue;
+        }
+        const auto& base_latencies = it->second;
+        std::cout << binary << ": " << base_latencies.size() << " vs "
+                  << next_latencies.size() << " runs";
+        if (base_latencies.size() < 2 || next_latencies.size() < 2) {
+            std::cout << ", too few to compare\n\n";
+            continue;
+        }
+
+        UTest u = MannWhitney(base_latencies, next_latencies);
+        const char* verdict = "no significant change";
+        if (u.p < 1 - confidence) {
+            verdict = u.superiority > 0.5 ? "SLOWER" : "faster";
+            if (u.superiority > 0.5) {
+                ret = kExitRegression;
+            }
+        }
+        std::cout << std::fixed << std::setprecision(3)
+                  << ", P(new slower)=" << u.superiority
+                  << std::defaultfloat << std::setprecision(3)
+                  << ", Mann-Whitney p=" << u.p << ": " << verdict << "\n";
+
+        std::vector<Interval> ci =
+            Bootstrap(base_latencies, next_latencies, quantiles, resamples,
+                      confidence, jobs, seed);
+        std::ostringstream ci_heading;
+        ci_heading << confidence * 100 << "% CI";
+        std::cout << "  " << std::left << std::setw(8) << "quantile"
+                  << std::right << std::setw(10) << "base" << std::setw(10)
+                  << "new" << std::setw(20) << "diff" << "  "
+                  << ci_heading.str() << "\n";
+        for (size_t qi = 0; qi < quantiles.size(); qi++) {
+            double b = base_latencies[QuantileRank(quantiles[qi],
+                                                   base_latencies.size())];
+            double n = next_latencies[QuantileRank(quantiles[qi],
+                                                   next_latencies.size())];
+            std::ostringstream diff;
+            diff << FormatDiff(n - b);
+            if (b > 0) {
+                diff << " (" << std::showpos << std::fixed
+                     << std::setprecision(1) << (n - b) / b * 100 << "%)";
+            }
+            bool excludes_zero = ci[qi].low > 0 || ci[qi].high < 0;
+            std::cout << "  " << std::left << std::setw(8)
+                      << FormatQuantile(quantiles[qi]) << std::right
+                      << std::setw(10) << FormatDuration(b) << std::setw(10)
+                      << FormatDuration(n) << std::setw(20) << diff.str()
+                      << "  [" << FormatDiff(ci[qi].low) << ", "
+                      << FormatDiff(ci[qi].high) << "]"
+                      << (excludes_zero ? " *" : "") << "\n";
+        }
+        std::cout << "\n";
+    }
+    return ret;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file mwflight.cc
+ * @brief Dump the wrapper flight recorder's ring of recent invocations.
+ *
+ * Usage: mwflight [-n invocations]
+ *
+ * Prints the records of the last n invocations (default: all the ring
+ * holds) to stdout, oldest first, whether or not they've been logged. This
+ * is the explicit trigger to go with the automatic dump on failure (see
+ * flightrec.h). It doesn't change what later failures will log.
+ */
+
+#include <cstdlib>
+#include <iostream>
+
+#include <getopt.h>
+
+#include "flightrec.h"
+#include "shm.h"
+
+using namespace mountwrapper;
+
+[[noreturn]] static void Usage(const char* progname) {
+    std::cerr << "Usage: " << progname << " [-n invocations]\n";
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t count = kFlightEntries;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n':
+                count = strtoull(optarg, nullptr, 10);
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+
+    auto ring = static_cast<const FlightRing*>(
+        MapSharedBlockReadOnly(kFlightBlockName, sizeof(FlightRing)));
+    if (ring == nullptr) {
+        std::cerr << argv[0] << ": no flight recorder (" << kFlightBlockName
+                  << "); is WRAPPER_FLIGHT_RECORDER set?\n";
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t to = ring->next.load(std::memory_order_acquire);
+    uint64_t from = to > count ? to - count : 0;
+    for (const auto& line : ReadFlightRing(ring, from, to)) {
+        std::cout << line << "\n";
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,227 @@
+/**
+ * @file mwinternal.h
+ * @brief Internals of libmountwrapper, shared between its translation units
+ * and the tools built alongside it. Not part of the stable API.
+ */
+
+#ifndef MWINTERNAL_H
+#define MWINTERNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "libmountwrapper.h"
+
+namespace mountwrapper {
+
+static constexpr char kDefaultOutputFile[] =
+    "/var/lib/storageos/logs/mountwrapper.log";
+
+static constexpr size_t kMaxEnvVarValueLength = 40;
+
+// Defaults for the "max_field_bytes" option, capping the argv and
+// environment fields of a record, and "max_record_bytes", capping the whole
+// execute record. Everything in it but those two fields is small and
+// bounded, and fits in kRecordFixedBytes.
+static constexpr size_t kDefaultMaxFieldBytes = 64 * 1024;
+static constexpr size_t kDefaultMaxRecordBytes = 128 * 1024;
+static constexpr size_t kRecordFixedBytes = 4096;
+
+// Exported to the child, holding the invocation's ID.
+static constexpr char kInvocationIdEnvVar[] = "WRAPPER_INVOCATION_ID";
+
+// W3C trace context, read from the caller and passed on to the child.
+static constexpr char kTraceParentEnvVar[] = "TRACEPARENT";
+
+// Print a message with strerror(err) and exit. Only for failures that can't
+// happen in practice; anything a caller could hit is returned as an errno.
+[[noreturn]] void error_sys(int err, const std::string& message);
+
+std::string EnvStringWithDefault(const std::string& env,
+                                 const std::string& default_value);
+
+// Seconds.nanoseconds of CLOCK_REALTIME.
+std::string GetNanoTimestring();
+
+// ISO 8601 UTC with microseconds, used to prefix each log line.
+std::string GetTimestamp();
+
+// A sample of the kernel's clock discipline state (adjtimex(2)), as the
+// execute record's clock:[...] field. Tools use the offset to line up logs
+// from different nodes.
+std::string GetClockSample();
+
+// A new time-ordered unique ID (UUIDv7) for an invocation; see invid.cc.
+std::string NewInvocationId();
+
+// 64 random bits from a fast per-thread generator; not for cryptography.
+uint64_t RandomU64();
+
+// CLOCK_MONOTONIC in nanoseconds, for measuring intervals.
+int64_t MonotonicNs();
+
+// Turn the given string vector into a comma-separated list of quoted
+// items, or a map into one of key=value items. Items that would take the
+// list past max_bytes are left out, and replaced by "...+<count> more".
+std::string GetVecString(const std::vector<std::string>& vec,
+                         size_t max_bytes = SIZE_MAX);
+
+std::string GetMapString(const std::map<std::string, std::string>& map,
+                         size_t max_bytes = SIZE_MAX);
+
+// Split KEY=value strings into a map of canonicalised values, as logged in
+// the execute record. Also picks out the raw TRACEPARENT, if asked.
+std::map<std::string, std::string> GetEnvMap(
+    const std::vector<std::string>& env,
+    std::string* traceparent);
+
+// Make a value safe and short for the log: non-printable characters become
+// '.', and values over kMaxEnvVarValueLength are cut short, ending
+// "...#<XXH64 of the whole value, in hex>".
+std::string CanonicaliseString(const std::string& input);
+
+// Append an item to the given vector with a timestamp prepended.
+void Log(std::vector<std::string>& out, const std::string& str);
+
+// If something goes wrong, dump what we have to stdout so it's not entirely
+// lost.
+void PanicDump(const std::vector<std::string>& output);
+
+// The phases of the wrapper's own work, timed for the overhead_ns:[...]
+// field that ends the completed record. Phases that didn't happen (e.g.
+// the log phases when the flight recorder keeps the records) are left out.
+enum OverheadPhase {
+    kOverheadCopy,      // Copying argv and the environment.
+    kOverheadCanon,     // Canonicalising the environment.
+    kOverheadFormat,    // Formatting the execute record.
+    kOverheadSetup,     // Slots, tracing, and the child's argv and envp.
+    kOverheadFork,      // fork(), as the parent sees it.
+    kOverheadComplete,  // Formatting the completed record, detection.
+    kOverheadMkdir,     // Creating the log directory.
+    kOverheadOpen,      // Opening the log.
+    kOverheadWrite,     // Writing the records ahead of the completed one.
+    kOverheadPhases
+};
+
+// Cumulative NFS RPC counters for one op, summed over the mounts of
+// interest; see nfsstats.h.
+struct NfsOpCounters {
+    uint64_t ops = 0;
+    uint64_t rtt_ms = 0;
+    uint64_t execute_ms = 0;
+};
+
+// W3C trace context for an invocation; see trace.cc.
+struct TraceContext {
+    bool active = false;   // There's a trace to propagate to the child.
+    bool sampled = false;  // ... and spans to export.
+    std::string trace_id;  // 32 hex digits.
+    std::string parent_span_id;  // 16 hex digits; empty for a new trace.
+    std::string span_id;         // The invocation's span.
+    uint8_t flags = 0;
+    int64_t realtime_offset_ns = 0;  // CLOCK_REALTIME - CLOCK_MONOTONIC.
+    int64_t forked_ns = 0;  // fork() returned in the parent.
+    int64_t exec_ns = 0;    // The child's exec succeeded or failed.
+};
+
+}  // namespace mountwrapper
+
+struct mw_invocation {
+    std::string binary;
+    std::vector<std::string> arg;  // Including argv[0].
+    std::vector<std::string> env;  // KEY=value, as passed to the child.
+    std::map<std::string, std::string> options;
+    std::string progname;  // basename(argv[0]), for messages.
+
+    std::string runtimestamp;  // Set by spawn.
+    std::string id;            // Set by spawn; joins the records.
+    std::string argstr;
+    std::vector<std::string> output;  // Records not yet flushed.
+
+    pid_t pid = -1;
+    bool reaped = false;
+    int wstatus = 0;
+    bool failed = false;  // Non-zero exit, signal or execve() failure.
+
+    // CLOCK_MONOTONIC, just before fork() and just after waitpid().
+    int64_t spawn_ns = 0;
+    int64_t exit_ns = 0;
+
+    std::string caller;  // The caller's name (caller.h), if known.
+
+    int slot = -1;  // Our in-flight slot for mounttop (slots.h), if any.
+
+    // For NFS mounts (nfsstats.h): how to pick out the mounts of interest
+    // in /proc/self/mountstats, and their counters before the fork.
+    std::string nfs_server;
+    std::vector<std::string> nfs_mountpoints;
+    std::map<std::string, mountwrapper::NfsOpCounters> nfs_before;
+
+    // The block device being mounted (blockstats.h), or 0, and its
+    // counters before the fork.
+    dev_t blockdev = 0;
+    std::vector<uint64_t> blockdev_before;
+
+    // Our taskstats listener (taskstats.h), if any.
+    int taskstats_fd = -1;
+    uint16_t taskstats_family = 0;
+
+    // Descriptors the child would inherit, and for the "close_fds" option
+    // (fds.h) whether to keep them from it and which not to (sorted).
+    std::vector<int> inherited_fds;
+    bool close_fds = false;
+    std::vector<int> keep_fds;
+
+    // Whether the child gets a trimmed environment (envtrim.h), and the
+    // names it may keep beyond the usual.
+    bool trim_env = false;
+    std::vector<std::string> env_allowlist;
+
+    // Nanoseconds spent in each OverheadPhase, or -1 if not (yet) timed,
+    // and the index in 'output' of the completed record they're appended
+    // to, or -1 once they have been.
+    int64_t overhead_ns[mountwrapper::kOverheadPhases];
+    int overhead_line = -1;
+
+    mountwrapper::TraceContext trace;
+};
+
+namespace mountwrapper {
+
+// A latency change point detected by DetectChangePoint().
+struct ChangePoint {
+    const char* direction = nullptr;  // "up" or "down"; null if none.
+    double baseline_ns = 0;           // Typical latency before the change.
+    double z = 0;                     // This sample's standardised residual.
+};
+
+// Feed an invocation's exec-to-exit latency to the node-wide change-point
+// detector for its binary (see detector.cc). Disabled by the "detect" option
+// set to 0.
+ChangePoint DetectChangePoint(const mw_invocation* inv, int64_t latency_ns);
+
+// Set up the invocation's trace context from the caller's TRACEPARENT (may
+// be empty), and export its spans once it has been reaped. See trace.cc.
+void TraceStart(mw_invocation* inv, const std::string& traceparent);
+std::string TraceParentForChild(const mw_invocation* inv);
+void TraceExport(const mw_invocation* inv);
+
+// The value of option 'name' (see libmountwrapper.h), falling back to the
+// WRAPPER_<NAME> environment variable and then to 'default_value'.
+std::string GetOption(const mw_invocation* inv,
+                      const std::string& name,
+                      const std::string& default_value);
+
+// A positive size option, or 'default_value' if unset or malformed.
+size_t SizeOption(const mw_invocation* inv,
+                  const std::string& name,
+                  size_t default_value);
+
+}  // namespace mountwrapper
+
+#endif  // MWINTERNAL_H
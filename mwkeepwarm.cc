@@ -0,0 +1,170 @@
+/**
+ * @file mwkeepwarm.cc
+ * @brief Keep wrapped binaries and their libraries resident in memory.
+ *
+ * Usage: mwkeepwarm [-i interval] binary...
+ *
+ * Maps each binary and the files exec'ing it maps (its ELF interpreter and
+ * shared libraries; see residency.h) and mlock()s them, so they stay in the
+ * page cache however hard the node is reclaiming and the wrapped binary
+ * never starts cold. Every interval seconds (default 60) the file set is
+ * checked again, and files that have been replaced, say by a package
+ * upgrade, are remapped. Runs until killed.
+ *
+ * Locking needs CAP_IPC_LOCK or a big enough RLIMIT_MEMLOCK. Without them
+ * the files are left mapped and paged back in with MADV_WILLNEED at each
+ * check, which is better than nothing.
+ */
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "residency.h"
+
+namespace {
+
+const char* progname = "mwkeepwarm";
+
+struct Pinned {
+    dev_t dev = 0;
+    ino_t ino = 0;
+    int64_t mtime_ns = 0;
+    void* map = nullptr;
+    size_t size = 0;
+    bool locked = false;
+};
+
+bool SameFile(const std::string& path, const Pinned& pin) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && st.st_dev == pin.dev &&
+           st.st_ino == pin.ino &&
+           st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec ==
+               pin.mtime_ns &&
+           static_cast<size_t>(st.st_size) == pin.size;
+}
+
+void Unpin(Pinned& pin) {
+    if (pin.map != nullptr) {
+        (void)munmap(pin.map, pin.size);  // Unlocks it too.
+        pin.map = nullptr;
+    }
+}
+
+bool Pin(const std::string& path, Pinned& pin) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        std::cerr << progname << ": " << path << ": " << strerror(errno)
+                  << "\n";
+        return false;
+    }
+    struct stat st = {};
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    int error = errno;
+    (void)close(fd);
+    if (map == MAP_FAILED) {
+        std::cerr << progname << ": " << path << ": "
+                  << (st.st_size > 0 ? strerror(error) : "empty file")
+                  << "\n";
+        return false;
+    }
+    pin.dev = st.st_dev;
+    pin.ino = st.st_ino;
+    pin.mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    pin.map = map;
+    pin.size = st.st_size;
+    pin.locked = mlock(map, pin.size) == 0;
+    if (!pin.locked) {
+        std::cerr << progname << ": " << path << ": mlock: "
+                  << strerror(errno) << " (keeping it mapped instead)\n";
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    progname = argv[0];
+    int interval = 60;
+    int opt;
+    while ((opt = getopt(argc, argv, "i:")) != -1) {
+        switch (opt) {
+            case 'i':
+                interval = atoi(optarg);
+                break;
+            default:
+                std::cerr << "Usage: " << progname
+                          << " [-i interval] binary...\n";
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind == argc || interval < 1) {
+        std::cerr << "Usage: " << progname << " [-i interval] binary...\n";
+        return EXIT_FAILURE;
+    }
+
+    std::map<std::string, Pinned> pinned;
+    for (;;) {
+        std::map<std::string, Pinned> wanted;
+        for (int n = optind; n < argc; n++) {
+            auto files = mountwrapper::ExecFiles(argv[n]);
+            if (files.empty()) {
+                std::cerr << progname << ": " << argv[n] << ": "
+                          << strerror(errno) << "\n";
+            }
+            for (const auto& path : files) {
+                wanted.emplace(path, Pinned());
+            }
+        }
+
+        bool changed = false;
+        for (auto& [path, pin] : pinned) {
+            auto it = wanted.find(path);
+            if (it != wanted.end() && SameFile(path, pin)) {
+                std::swap(it->second, pin);
+            } else {
+                Unpin(pin);
+                changed = true;
+            }
+        }
+        size_t bytes = 0;
+        size_t locked = 0;
+        for (auto it = wanted.begin(); it != wanted.end();) {
+            auto& pin = it->second;
+            if (pin.map == nullptr) {
+                changed = true;
+                if (!Pin(it->first, pin)) {
+                    it = wanted.erase(it);
+                    continue;
+                }
+            }
+            if (!pin.locked) {
+                (void)madvise(pin.map, pin.size, MADV_WILLNEED);
+            }
+            bytes += pin.size;
+            locked += pin.locked;
+            ++it;
+        }
+        pinned.swap(wanted);
+        if (changed) {
+            std::cerr << progname << ": holding " << pinned.size()
+                      << " files (" << locked << " locked), "
+                      << bytes / 1024 << " KiB\n";
+        }
+        sleep(interval);
+    }
+}
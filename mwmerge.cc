@@ -0,0 +1,223 @@
+/**
+ * @file mwmerge.cc
+ * @brief Merge mountwrapper logs into one stream ordered by runtimestamp.
+ *
+ * Usage: mwmerge [-c] [-l] [-w window] file...
+ *
+ * Intended for sharded logs (WRAPPER_SHARDS), e.g.
+ * 'mwmerge /var/lib/storageos/logs/mountwrapper.log.*', and for logs
+ * collected from many nodes. Each file is only nearly ordered by
+ * runtimestamp, since records are appended when a run completes rather than
+ * when it starts, so each input is read through a reorder window of the
+ * given number of records and the inputs are then k-way merged. Memory is
+ * bounded by files * window; the default window shrinks as the number of
+ * files grows. If the window was too small to restore the order, a warning
+ * says so.
+ *
+ * -c corrects for clock skew between nodes: each record is ordered by its
+ * time plus the adjtimex(2) offset from the latest clock:[...] sample in the
+ * same file. Samples from unsynchronised clocks are counted and reported.
+ * -l prefixes each output line with its file name.
+ *
+ * Lines that aren't wrapper records are ordered by their timestamp prefix if
+ * they have one, and otherwise emitted as soon as they're read.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+#include <string.h>
+
+#include "logrecord.h"
+
+using mountwrapper::LogRecord;
+
+static constexpr size_t kMaxDefaultWindow = 4096;
+static constexpr size_t kMinDefaultWindow = 64;
+// Default total number of records held across all the windows.
+static constexpr size_t kDefaultBudget = 256 * 1024;
+
+namespace {
+
+struct Entry {
+    int64_t time;
+    uint64_t seq;  // Read order within the input, to keep ties stable.
+    std::string line;
+
+    bool operator>(const Entry& other) const {
+        return time != other.time ? time > other.time : seq > other.seq;
+    }
+};
+
+// One input file and its reorder window.
+class Input {
+   public:
+    Input(const std::string& name, bool correct)
+        : name_(name), in_(name), correct_(correct) {}
+
+    bool ok() const { return static_cast<bool>(in_); }
+    const std::string& name() const { return name_; }
+
+    // Top up the window from the file.
+    void Fill(size_t window) {
+        std::string line;
+        while (window_.size() < window && std::getline(in_, line)) {
+            LogRecord rec;
+            mountwrapper::ParseLogRecord(line, rec);
+            if (rec.has_clock) {
+                offset_ns_ = rec.clock_offset_ns;
+                if (!rec.clock_synced) {
+                    unsynced_++;
+                }
+            }
+            int64_t time = mountwrapper::RecordTime(rec);
+            if (time == 0) {
+                // No timestamp at all; keep it next to what preceded it.
+                time = last_time_;
+            } else if (correct_) {
+                time += offset_ns_;
+            }
+            last_time_ = time;
+            window_.push(Entry{time, seq_++, std::move(line)});
+        }
+    }
+
+    bool empty() const { return window_.empty(); }
+    uint64_t unsynced() const { return unsynced_; }
+    const Entry& top() const { return window_.top(); }
+    Entry Pop() {
+        Entry e = window_.top();
+        window_.pop();
+        return e;
+    }
+
+   private:
+    std::string name_;
+    std::ifstream in_;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>>
+        window_;
+    bool correct_;
+    uint64_t seq_ = 0;
+    int64_t last_time_ = 0;
+    int64_t offset_ns_ = 0;  // From the latest clock sample.
+    uint64_t unsynced_ = 0;
+};
+
+struct Head {
+    int64_t time;
+    size_t input;
+    uint64_t seq;
+
+    bool operator>(const Head& other) const {
+        if (time != other.time)
+            return time > other.time;
+        if (input != other.input)
+            return input > other.input;
+        return seq > other.seq;
+    }
+};
+
+[[noreturn]] void Usage(const char* progname) {
+    std::cerr << "Usage: " << progname << " [-c] [-l] [-w window] file...\n";
+    exit(EXIT_FAILURE);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t window = 0;
+    bool correct = false;
+    bool label = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "clw:")) != -1) {
+        switch (opt) {
+            case 'c':
+                correct = true;
+                break;
+            case 'l':
+                label = true;
+                break;
+            case 'w':
+                window = strtoul(optarg, nullptr, 10);
+                if (window == 0) {
+                    Usage(argv[0]);
+                }
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (optind == argc) {
+        Usage(argv[0]);
+    }
+    if (window == 0) {
+        size_t nfiles = argc - optind;
+        window = std::clamp(kDefaultBudget / nfiles, kMinDefaultWindow,
+                            kMaxDefaultWindow);
+    }
+
+    std::vector<std::unique_ptr<Input>> inputs;
+    for (int n = optind; n < argc; n++) {
+        auto input = std::make_unique<Input>(argv[n], correct);
+        if (!input->ok()) {
+            std::cerr << argv[0] << ": " << argv[n] << ": " << strerror(errno)
+                      << "\n";
+            exit(EXIT_FAILURE);
+        }
+        inputs.push_back(std::move(input));
+    }
+
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    for (size_t n = 0; n < inputs.size(); n++) {
+        inputs[n]->Fill(window);
+        if (!inputs[n]->empty()) {
+            heads.push(Head{inputs[n]->top().time, n, inputs[n]->top().seq});
+        }
+    }
+
+    uint64_t out_of_order = 0;
+    int64_t last_time = 0;
+    while (!heads.empty()) {
+        auto head = heads.top();
+        heads.pop();
+        auto& input = *inputs[head.input];
+        Entry e = input.Pop();
+        if (e.time < last_time) {
+            out_of_order++;
+        } else {
+            last_time = e.time;
+        }
+        if (label) {
+            std::cout << input.name() << ": ";
+        }
+        std::cout << e.line << "\n";
+
+        input.Fill(window);
+        if (!input.empty()) {
+            heads.push(Head{input.top().time, head.input, input.top().seq});
+        }
+    }
+    std::cout.flush();
+
+    for (const auto& input : inputs) {
+        if (input->unsynced() != 0) {
+            std::cerr << argv[0] << ": warning: " << input->name() << ": "
+                      << input->unsynced()
+                      << " clock samples were not synchronised\n";
+        }
+    }
+    if (out_of_order != 0) {
+        std::cerr << argv[0] << ": warning: " << out_of_order
+                  << " records are out of order; try a larger -w\n";
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,226 @@
+/**
+ * @file mwoverhead.cc
+ * @brief Summarise the wrapper's own overhead from its logs.
+ *
+ * Usage: mwoverhead [-b binary] [-c caller] [-H] [log...]
+ *
+ * Reads the overhead_ns:[...] fields of the completed records in the given
+ * logs (stdin if none), optionally just those of one binary or caller, and
+ * prints, for each phase of the wrapper's work and for their total, how
+ * many runs timed it and the mean, p50, p99 and max, followed by the total
+ * relative to the runs' latency. -H adds a histogram of each phase in
+ * power-of-two buckets. See OverheadPhase in
+ * mwinternal.h for what each phase covers.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+#include "logrecord.h"
+#include "sketch.h"
+
+using mountwrapper::LatencySketch;
+using mountwrapper::LogRecord;
+
+namespace {
+
+constexpr int kBuckets = 40;  // Up to 2^40ns, about 18 minutes.
+constexpr int kBarWidth = 40;
+
+const char* progname = "mwoverhead";
+
+struct Phase {
+    std::string name;
+    LatencySketch sketch;
+    uint64_t buckets[kBuckets] = {};
+
+    void Add(int64_t ns) {
+        sketch.Add(ns);
+        int b = 0;
+        while (b < kBuckets - 1 && ns >= (int64_t{2} << b)) {
+            b++;
+        }
+        buckets[b]++;
+    }
+};
+
+class Summary {
+   public:
+    void Add(const LogRecord& rec) {
+        if (rec.overhead_ns.empty()) {
+            return;
+        }
+        int64_t total = 0;
+        for (const auto& [name, ns] : rec.overhead_ns) {
+            Find(name).Add(ns);
+            total += ns;
+        }
+        total_.name = "total";
+        total_.Add(total);
+        total_ns_ += total;
+        latency_ns_ += rec.latency_ns;
+    }
+
+    void Print(bool histograms) const {
+        if (total_.sketch.count() == 0) {
+            std::cout << "no overhead fields found\n";
+            return;
+        }
+        std::cout << std::left << std::setw(10) << "PHASE" << std::right
+                  << std::setw(10) << "RUNS" << std::setw(10) << "MEAN"
+                  << std::setw(10) << "P50" << std::setw(10) << "P99"
+                  << std::setw(10) << "MAX" << "\n";
+        for (const auto& phase : phases_) {
+            PrintRow(phase);
+        }
+        PrintRow(total_);
+        if (latency_ns_ > 0) {
+            // The fork phase is inside the latency, but the rest isn't.
+            std::cout << "\nwrapper overhead is " << std::fixed
+                      << std::setprecision(2)
+                      << 100.0 * total_ns_ / latency_ns_
+                      << "% of the runs' exec-to-exit latency\n";
+        }
+        if (histograms) {
+            for (const auto& phase : phases_) {
+                PrintHistogram(phase);
+            }
+            PrintHistogram(total_);
+        }
+    }
+
+   private:
+    // Phases are kept in the order they're first seen, which is the order
+    // the wrapper does them in.
+    Phase& Find(const std::string& name) {
+        for (auto& phase : phases_) {
+            if (phase.name == name) {
+                return phase;
+            }
+        }
+        phases_.emplace_back();
+        phases_.back().name = name;
+        return phases_.back();
+    }
+
+    static std::string FormatDuration(double ns) {
+        std::ostringstream ss;
+        ss << std::fixed;
+        if (ns < 1000000) {
+            ss << std::setprecision(1) << ns / 1e3 << "us";
+        } else if (ns < 1000000000) {
+            ss << std::setprecision(1) << ns / 1e6 << "ms";
+        } else {
+            ss << std::setprecision(2) << ns / 1e9 << "s";
+        }
+        return ss.str();
+    }
+
+    static void PrintRow(const Phase& phase) {
+        const auto& s = phase.sketch;
+        std::cout << std::left << std::setw(10) << phase.name << std::right
+                  << std::setw(10) << s.count() << std::setw(10)
+                  << FormatDuration(s.mean()) << std::setw(10)
+                  << FormatDuration(s.Quantile(0.5)) << std::setw(10)
+                  << FormatDuration(s.Quantile(0.99)) << std::setw(10)
+                  << FormatDuration(s.max()) << "\n";
+    }
+
+    static void PrintHistogram(const Phase& phase) {
+        int first = 0;
+        int last = kBuckets - 1;
+        while (first < last && phase.buckets[first] == 0) {
+            first++;
+        }
+        while (last > first && phase.buckets[last] == 0) {
+            last--;
+        }
+        uint64_t most =
+            *std::max_element(phase.buckets, phase.buckets + kBuckets);
+        std::cout << "\n" << phase.name << ":\n";
+        for (int b = first; b <= last; b++) {
+            int width =
+                static_cast<int>(phase.buckets[b] * kBarWidth / most);
+            std::cout << "  < " << std::left << std::setw(9)
+                      << FormatDuration(static_cast<double>(int64_t{2} << b))
+                      << std::right << " |" << std::string(width, '#')
+                      << std::string(kBarWidth - width, ' ') << "| "
+                      << phase.buckets[b] << "\n";
+        }
+    }
+
+    std::vector<Phase> phases_;
+    Phase total_;
+    int64_t total_ns_ = 0;
+    int64_t latency_ns_ = 0;
+};
+
+void Summarise(std::istream& in,
+               const std::string& binary,
+               const std::string& caller,
+               Summary& summary) {
+    std::string line;
+    LogRecord rec;
+    while (std::getline(in, line)) {
+        if (mountwrapper::ParseLogRecord(line, rec) &&
+            rec.kind == "completed" &&
+            (binary.empty() || rec.binary == binary) &&
+            (caller.empty() || rec.caller == caller)) {
+            summary.Add(rec);
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    progname = argv[0];
+    std::string binary;
+    std::string caller;
+    bool histograms = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:c:H")) != -1) {
+        switch (opt) {
+            case 'b':
+                binary = optarg;
+                break;
+            case 'c':
+                caller = optarg;
+                break;
+            case 'H':
+                histograms = true;
+                break;
+            default:
+                std::cerr << "Usage: " << progname
+                          << " [-b binary] [-c caller] [-H] [log...]\n";
+                return EXIT_FAILURE;
+        }
+    }
+
+    Summary summary;
+    if (optind == argc) {
+        Summarise(std::cin, binary, caller, summary);
+    }
+    for (int n = optind; n < argc; n++) {
+        std::ifstream in(argv[n]);
+        if (!in) {
+            std::cerr << progname << ": " << argv[n] << ": "
+                      << strerror(errno) << "\n";
+            return EXIT_FAILURE;
+        }
+        Summarise(in, binary, caller, summary);
+    }
+    summary.Print(histograms);
+    return EXIT_SUCCESS;
+}
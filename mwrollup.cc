@@ -0,0 +1,608 @@
+/**
+ * @file mwrollup.cc
+ * @brief Incremental per-minute and per-hour rollups of wrapper logs.
+ *
+ * Usage: mwrollup update rollup log
+ *        mwrollup show [-r minute|hour] [-b binary] [-c caller] [-C]
+ *                      [-s start] [-e end] rollup
+ *
+ * update reads the completed records that have been appended to 'log' since
+ * the last update and appends their per-minute and per-hour buckets, one
+ * per binary and caller, to the rollup file: count, failures, signals and
+ * a mergeable latency sketch (min, max, mean and quantiles to within 1%).
+ * It then records how far into the log it got, keyed by the log's path and
+ * inode, so the next update starts there. A log that was rotated (a new
+ * inode) or truncated is read from the start. Only complete lines are
+ * consumed, so it's safe to run against a log the wrapper is still writing
+ * to, e.g. from cron.
+ *
+ * The rollup file is append-only: the magic, then records of
+ *
+ *   varint type, varint length, payload
+ *
+ * where a bucket payload is resolution and start (seconds), binary, caller
+ * (empty for logs that don't name one), count, failures, signals and the
+ * sketch, and a checkpoint payload is the log's path, inode and offset and
+ * the time of the update. A bucket that spans two updates appears twice and
+ * is merged when read.
+ *
+ * Each update ends with the checkpoints of every log rolled up so far,
+ * then a fixed-size trailer record giving their length, so the next update
+ * reads just the tail of the file rather than the whole history. An update
+ * that died half way through a write leaves no trailer at the end; the
+ * next update then scans the whole file once, and truncates away the
+ * partial record.
+ *
+ * show merges and prints the buckets at one resolution (default minute),
+ * per binary or with -C per binary and caller. -c picks one caller.
+ * Times are Unix seconds or %Y-%m-%dT%H:%M:%S (UTC).
+ */
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logrecord.h"
+#include "sketch.h"
+#include "varint.h"
+
+using mountwrapper::LatencySketch;
+using mountwrapper::LogRecord;
+using mountwrapper::PutString;
+using mountwrapper::PutVarint;
+using mountwrapper::UnZigZag;
+using mountwrapper::VarintReader;
+using mountwrapper::ZigZag;
+
+namespace {
+
+constexpr char kMagic[8] = {'M', 'W', 'R', 'O', 'L', 'L', '\x01', '\0'};
+constexpr int64_t kResolutions[] = {60, 3600};
+constexpr size_t kReadSize = 1 << 20;
+
+enum RecordType { kBucket = 1, kCheckpoint = 2, kTrailer = 3 };
+
+// The trailer: type, payload length, then the length of the checkpoints
+// before it (64-bit little-endian) and a marker.
+constexpr char kTrailerMarker[4] = {'M', 'W', 'C', 'K'};
+constexpr size_t kTrailerPayload = 8 + sizeof(kTrailerMarker);
+constexpr size_t kTrailerSize = 2 + kTrailerPayload;
+
+const char* progname = "mwrollup";
+
+[[noreturn]] void Fatal(const std::string& message) {
+    std::cerr << progname << ": " << message << "\n";
+    exit(EXIT_FAILURE);
+}
+
+// Resolution, start, binary, caller.
+using BucketKey = std::tuple<int64_t, int64_t, std::string, std::string>;
+
+struct Bucket {
+    uint64_t count = 0;
+    uint64_t failures = 0;
+    uint64_t signals = 0;
+    LatencySketch latency;
+
+    void Add(const LogRecord& rec) {
+        count++;
+        failures += mountwrapper::StatusFailed(rec.status);
+        signals += rec.status < 0;
+        latency.Add(rec.latency_ns);
+    }
+
+    void Merge(const Bucket& other) {
+        count += other.count;
+        failures += other.failures;
+        signals += other.signals;
+        latency.Merge(other.latency);
+    }
+};
+
+using Buckets = std::map<BucketKey, Bucket>;
+
+struct Checkpoint {
+    std::string path;
+    uint64_t inode = 0;
+    uint64_t offset = 0;
+    int64_t time = 0;
+};
+
+//
+// The rollup file.
+//
+
+void PutRecord(std::string& out,
+               RecordType type,
+               const std::string& payload) {
+    PutVarint(out, type);
+    PutString(out, payload);
+}
+
+void PutBucket(std::string& out, const BucketKey& key, const Bucket& b) {
+    std::string payload;
+    PutVarint(payload, std::get<0>(key));
+    PutVarint(payload, ZigZag(std::get<1>(key)));
+    PutString(payload, std::get<2>(key));
+    PutString(payload, std::get<3>(key));
+    PutVarint(payload, b.count);
+    PutVarint(payload, b.failures);
+    PutVarint(payload, b.signals);
+    b.latency.Encode(payload);
+    PutRecord(out, kBucket, payload);
+}
+
+void PutCheckpoint(std::string& out, const Checkpoint& cp) {
+    std::string payload;
+    PutString(payload, cp.path);
+    PutVarint(payload, cp.inode);
+    PutVarint(payload, cp.offset);
+    PutVarint(payload, ZigZag(cp.time));
+    PutRecord(out, kCheckpoint, payload);
+}
+
+// Appends the trailer for the 'length' bytes of checkpoints before it.
+void PutTrailer(std::string& out, uint64_t length) {
+    out += static_cast<char>(kTrailer);
+    out += static_cast<char>(kTrailerPayload);
+    for (int n = 0; n < 8; n++) {
+        out += static_cast<char>(length >> (8 * n));
+    }
+    out.append(kTrailerMarker, sizeof(kTrailerMarker));
+}
+
+bool DecodeBucket(const std::string& payload, BucketKey& key, Bucket& b) {
+    VarintReader r(payload.data(), payload.size());
+    uint64_t resolution, start;
+    std::string binary;
+    std::string caller;
+    if (!r.Varint(resolution) || !r.Varint(start) || !r.String(binary) ||
+        !r.String(caller) || !r.Varint(b.count) || !r.Varint(b.failures) ||
+        !r.Varint(b.signals) || !b.latency.Decode(r) ||
+        r.remaining() != 0) {
+        return false;
+    }
+    key = BucketKey(resolution, UnZigZag(start), binary, caller);
+    return true;
+}
+
+bool DecodeCheckpoint(const std::string& payload, Checkpoint& cp) {
+    VarintReader r(payload.data(), payload.size());
+    uint64_t time;
+    if (!r.String(cp.path) || !r.Varint(cp.inode) || !r.Varint(cp.offset) ||
+        !r.Varint(time)) {
+        return false;
+    }
+    cp.time = UnZigZag(time);
+    return true;
+}
+
+std::string ReadAll(int fd, const std::string& path) {
+    std::string data;
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) != 0) {
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            Fatal(path + ": " + strerror(errno));
+        }
+        data.append(buf, n);
+    }
+    return data;
+}
+
+// Calls fn(type, payload) for each complete record of a rollup file's
+// contents, and returns the length of the valid prefix of 'data'.
+template <typename Fn>
+size_t ForEachRecord(const std::string& data,
+                     const std::string& path,
+                     Fn fn) {
+    if (data.empty()) {
+        return 0;
+    }
+    if (data.size() < sizeof(kMagic) ||
+        memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) {
+        Fatal(path + ": not a rollup file");
+    }
+    size_t valid = sizeof(kMagic);
+    VarintReader r(data.data() + valid, data.size() - valid);
+    uint64_t type;
+    std::string payload;
+    while (r.remaining() != 0 && r.Varint(type) && r.String(payload)) {
+        fn(type, payload);
+        valid = data.size() - r.remaining();
+    }
+    return valid;
+}
+
+//
+// update
+//
+
+// The checkpoints of every log, by path.
+using Checkpoints = std::map<std::string, Checkpoint>;
+
+// Reads the checkpoints the last update left at the end of the file, which
+// is 'size' bytes long. Returns false if it doesn't end in a trailer, or
+// what the trailer points to doesn't decode.
+bool ReadTail(int fd, uint64_t size, Checkpoints& checkpoints) {
+    char trailer[kTrailerSize];
+    if (size < sizeof(kMagic) + kTrailerSize ||
+        pread(fd, trailer, kTrailerSize, size - kTrailerSize) !=
+            static_cast<ssize_t>(kTrailerSize) ||
+        trailer[0] != kTrailer || trailer[1] != kTrailerPayload ||
+        memcmp(trailer + 10, kTrailerMarker, sizeof(kTrailerMarker)) != 0) {
+        return false;
+    }
+    uint64_t length = 0;
+    for (int n = 0; n < 8; n++) {
+        length |= static_cast<uint64_t>(static_cast<uint8_t>(trailer[2 + n]))
+                  << (8 * n);
+    }
+    if (length > size - sizeof(kMagic) - kTrailerSize) {
+        return false;
+    }
+    std::string data(length, '\0');
+    if (pread(fd, &data[0], length, size - kTrailerSize - length) !=
+        static_cast<ssize_t>(length)) {
+        return false;
+    }
+    VarintReader r(data.data(), data.size());
+    uint64_t type;
+    std::string payload;
+    while (r.remaining() != 0) {
+        Checkpoint cp;
+        if (!r.Varint(type) || !r.String(payload) || type != kCheckpoint ||
+            !DecodeCheckpoint(payload, cp)) {
+            return false;
+        }
+        checkpoints[cp.path] = cp;
+    }
+    return true;
+}
+
+// Reads the complete lines of 'fd' from 'offset' on, adding the completed
+// records to 'buckets'. Returns the offset just past the last full line.
+uint64_t RollLog(int fd,
+                 const std::string& path,
+                 uint64_t offset,
+                 Buckets& buckets,
+                 uint64_t& records) {
+    std::string pending;
+    std::vector<char> buf(kReadSize);
+    LogRecord rec;
+    for (;;) {
+        ssize_t n =
+            pread(fd, buf.data(), buf.size(), offset + pending.size());
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            Fatal(path + ": " + strerror(errno));
+        }
+        if (n == 0) {
+            break;
+        }
+        pending.append(buf.data(), n);
+        size_t start = 0;
+        size_t nl;
+        while ((nl = pending.find('\n', start)) != std::string::npos) {
+            std::string line = pending.substr(start, nl - start);
+            start = nl + 1;
+            if (!mountwrapper::ParseLogRecord(line, rec) ||
+                rec.kind != "completed" || !rec.has_status) {
+                continue;
+            }
+            int64_t secs = mountwrapper::RecordTime(rec) / 1000000000LL;
+            for (int64_t res : kResolutions) {
+                int64_t bucket = secs - ((secs % res) + res) % res;
+                buckets[BucketKey(res, bucket, rec.binary, rec.caller)]
+                    .Add(rec);
+            }
+            records++;
+        }
+        offset += start;
+        pending.erase(0, start);
+    }
+    return offset;
+}
+
+int Update(int argc, char* argv[]) {
+    if (argc != 3) {
+        return EXIT_FAILURE;
+    }
+    std::string rollup_path = argv[1];
+    std::string log_path = argv[2];
+
+    int rollup = open(rollup_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC,
+                      0644);
+    if (rollup == -1) {
+        Fatal(rollup_path + ": " + strerror(errno));
+    }
+    // Keep two updates from interleaving their appends.
+    if (lockf(rollup, F_LOCK, 0) == -1) {
+        Fatal(rollup_path + ": " + strerror(errno));
+    }
+    struct stat rollup_st;
+    if (fstat(rollup, &rollup_st) == -1) {
+        Fatal(rollup_path + ": " + strerror(errno));
+    }
+    Checkpoints checkpoints;
+    uint64_t valid = rollup_st.st_size;
+    if (!ReadTail(rollup, valid, checkpoints)) {
+        // New, or an update didn't finish: go through the lot.
+        checkpoints.clear();
+        std::string data = ReadAll(rollup, rollup_path);
+        valid = ForEachRecord(
+            data, rollup_path,
+            [&](uint64_t type, const std::string& payload) {
+                Checkpoint cp;
+                if (type == kCheckpoint && DecodeCheckpoint(payload, cp)) {
+                    checkpoints[cp.path] = cp;
+                }
+            });
+        if (valid != data.size()) {
+            std::cerr << progname << ": " << rollup_path << ": discarding "
+                      << data.size() - valid
+                      << " bytes of a partial record\n";
+            if (ftruncate(rollup, valid) == -1) {
+                Fatal(rollup_path + ": " + strerror(errno));
+            }
+        }
+    }
+    Checkpoint last = checkpoints[log_path];
+
+    int log = open(log_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (log == -1) {
+        Fatal(log_path + ": " + strerror(errno));
+    }
+    struct stat st;
+    if (fstat(log, &st) == -1) {
+        Fatal(log_path + ": " + strerror(errno));
+    }
+    uint64_t offset = last.offset;
+    if (last.inode != st.st_ino ||
+        offset > static_cast<uint64_t>(st.st_size)) {
+        offset = 0;
+    }
+
+    Buckets buckets;
+    uint64_t records = 0;
+    Checkpoint cp;
+    cp.path = log_path;
+    cp.inode = st.st_ino;
+    cp.offset = RollLog(log, log_path, offset, buckets, records);
+    cp.time = time(nullptr);
+    close(log);
+
+    std::string out;
+    if (valid == 0) {
+        out.append(kMagic, sizeof(kMagic));
+    }
+    for (const auto& [key, bucket] : buckets) {
+        PutBucket(out, key, bucket);
+    }
+    checkpoints[log_path] = cp;
+    size_t checkpoints_start = out.size();
+    for (const auto& [path, c] : checkpoints) {
+        PutCheckpoint(out, c);
+    }
+    PutTrailer(out, out.size() - checkpoints_start);
+    // One write, so that the buckets and the checkpoints that account for
+    // them land together or are truncated away together.
+    if (pwrite(rollup, out.data(), out.size(), valid) !=
+        static_cast<ssize_t>(out.size())) {
+        Fatal(rollup_path + ": " + strerror(errno));
+    }
+    if (fsync(rollup) == -1) {
+        Fatal(rollup_path + ": " + strerror(errno));
+    }
+    close(rollup);
+
+    std::cerr << progname << ": rolled up " << records << " records from "
+              << cp.offset - offset << " bytes into " << buckets.size()
+              << " buckets\n";
+    return EXIT_SUCCESS;
+}
+
+//
+// show
+//
+
+int64_t ParseTime(const char* str) {
+    if (strchr(str, 'T') != nullptr) {
+        struct tm bdtime;
+        memset(&bdtime, 0, sizeof(bdtime));
+        const char* rest = strptime(str, "%Y-%m-%dT%H:%M:%S", &bdtime);
+        if (rest == nullptr || *rest != '\0') {
+            Fatal(std::string("bad time '") + str + "'");
+        }
+        return timegm(&bdtime);
+    }
+    char* end;
+    long long secs = strtoll(str, &end, 10);
+    if (*end != '\0') {
+        Fatal(std::string("bad time '") + str + "'");
+    }
+    return secs;
+}
+
+std::string FormatTime(int64_t secs) {
+    time_t t = secs;
+    struct tm bdtime;
+    gmtime_r(&t, &bdtime);
+    char buf[64];
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M", &bdtime);
+    return buf;
+}
+
+std::string FormatDuration(double ns) {
+    std::ostringstream ss;
+    ss << std::fixed;
+    if (ns < 1000000) {
+        ss << std::setprecision(0) << ns / 1e3 << "us";
+    } else if (ns < 1000000000) {
+        ss << std::setprecision(1) << ns / 1e6 << "ms";
+    } else {
+        ss << std::setprecision(2) << ns / 1e9 << "s";
+    }
+    return ss.str();
+}
+
+int Show(int argc, char* argv[]) {
+    int64_t resolution = 60;
+    int64_t start = INT64_MIN;
+    int64_t end = INT64_MAX;
+    std::string binary;
+    bool has_binary = false;
+    std::string caller;
+    bool has_caller = false;
+    bool by_caller = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:b:c:Cs:e:")) != -1) {
+        switch (opt) {
+            case 'r':
+                if (strcmp(optarg, "minute") == 0) {
+                    resolution = 60;
+                } else if (strcmp(optarg, "hour") == 0) {
+                    resolution = 3600;
+                } else {
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'b':
+                binary = optarg;
+                has_binary = true;
+                break;
+            case 'c':
+                caller = optarg;
+                has_caller = true;
+                break;
+            case 'C':
+                by_caller = true;
+                break;
+            case 's':
+                start = ParseTime(optarg);
+                break;
+            case 'e':
+                end = ParseTime(optarg);
+                break;
+            default:
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind + 1 != argc) {
+        return EXIT_FAILURE;
+    }
+    std::string path = argv[optind];
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        Fatal(path + ": " + strerror(errno));
+    }
+    std::string data = ReadAll(fd, path);
+    close(fd);
+
+    Buckets buckets;
+    size_t valid = ForEachRecord(
+        data, path, [&](uint64_t type, const std::string& payload) {
+            BucketKey key;
+            Bucket bucket;
+            if (type != kBucket) {
+                return;
+            }
+            if (!DecodeBucket(payload, key, bucket)) {
+                Fatal(path + ": corrupt bucket record");
+            }
+            auto& [res, bucket_start, bucket_binary, bucket_caller] = key;
+            if (res != resolution || bucket_start < start ||
+                bucket_start >= end ||
+                (has_binary && bucket_binary != binary) ||
+                (has_caller && bucket_caller != caller)) {
+                return;
+            }
+            if (!by_caller) {
+                bucket_caller.clear();
+            }
+            buckets[key].Merge(bucket);
+        });
+    if (valid != data.size()) {
+        std::cerr << progname << ": " << path << ": ignoring "
+                  << data.size() - valid << " bytes of a partial record\n";
+    }
+
+    std::cout << std::left << std::setw(17) << "TIME" << " " << std::setw(24)
+              << "BINARY";
+    if (by_caller) {
+        std::cout << " " << std::setw(16) << "CALLER";
+    }
+    std::cout << std::right << std::setw(8) << "COUNT"
+              << std::setw(7) << "FAIL" << std::setw(6) << "SIG"
+              << std::setw(10) << "MIN" << std::setw(10) << "MEAN"
+              << std::setw(10) << "P50" << std::setw(10) << "P99" << "\n";
+    for (const auto& [key, b] : buckets) {
+        std::cout << std::left << std::setw(17)
+                  << FormatTime(std::get<1>(key)) << " " << std::setw(24)
+                  << std::get<2>(key);
+        if (by_caller) {
+            const auto& name = std::get<3>(key);
+            std::cout << " " << std::setw(16) << (name.empty() ? "-" : name);
+        }
+        std::cout << std::right << std::setw(8) << b.count << std::setw(7)
+                  << b.failures << std::setw(6) << b.signals << std::setw(10)
+                  << FormatDuration(b.latency.min()) << std::setw(10)
+                  << FormatDuration(b.latency.mean()) << std::setw(10)
+                  << FormatDuration(b.latency.Quantile(0.5)) << std::setw(10)
+                  << FormatDuration(b.latency.Quantile(0.99)) << "\n";
+    }
+    return EXIT_SUCCESS;
+}
+
+[[noreturn]] void Usage() {
+    std::cerr << "Usage: " << progname << " update rollup log\n"
+              << "       " << progname
+              << " show [-r minute|hour] [-b binary] [-c caller] [-C]\n"
+              << "                     [-s start] [-e end] rollup\n";
+    exit(EXIT_FAILURE);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    progname = argv[0];
+    if (argc < 2) {
+        Usage();
+    }
+    std::string command = argv[1];
+    // Let getopt() see the subcommand's arguments only.
+    argc--;
+    argv++;
+    int ret;
+    if (command == "update") {
+        ret = Update(argc, argv);
+    } else if (command == "show") {
+        ret = Show(argc, argv);
+    } else {
+        Usage();
+    }
+    if (ret != EXIT_SUCCESS) {
+        Usage();
+    }
+    return ret;
+}
@@ -0,0 +1,123 @@
+/**
+ * @file mwspool.cc
+ * @brief Show, or move into place, records spooled for unwritable logs.
+ *
+ * Usage: mwspool [-d dir] [-r] log...
+ *
+ * For each log, prints the size of its spool (see spool.h) and how many
+ * records are waiting in it. The spool is looked for in dir, which
+ * defaults to $WRAPPER_SPOOL_DIR or, failing that, where the wrapper puts
+ * it by default. Sharded logs have a spool per shard, so name the shards.
+ * With -r the records are appended to the log, as the next wrapper to
+ * write it would, and the spool emptied; useful when nothing else is
+ * going to run for a while, or before collecting the log.
+ */
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "spool.h"
+
+namespace {
+
+const char* progname = "mwspool";
+
+void Usage() {
+    std::cerr << "Usage: " << progname << " [-d dir] [-r] log...\n";
+    exit(EXIT_FAILURE);
+}
+
+// The number of records in a spool: one per line.
+size_t CountRecords(const std::string& spool, size_t* bytes) {
+    *bytes = 0;
+    int fd = open(spool.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1 || st.st_size == 0) {
+        if (fd != -1) {
+            (void)close(fd);
+        }
+        return 0;
+    }
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    (void)close(fd);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    const char* data = static_cast<const char*>(map);
+    size_t records = 0;
+    for (const char* p = data;
+         (p = static_cast<const char*>(
+              memchr(p, '\n', data + st.st_size - p))) != nullptr;
+         p++) {
+        // Not the empty line that ends a record cut short in the log.
+        records += p > data && p[-1] != '\n';
+    }
+    (void)munmap(map, st.st_size);
+    *bytes = st.st_size;
+    return records;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    progname = argv[0];
+    const char* env_dir = getenv("WRAPPER_SPOOL_DIR");
+    std::string dir = env_dir != nullptr && *env_dir != '\0'
+                          ? env_dir
+                          : mountwrapper::DefaultSpoolDir();
+    bool replay = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:r")) != -1) {
+        switch (opt) {
+            case 'd':
+                dir = optarg;
+                break;
+            case 'r':
+                replay = true;
+                break;
+            default:
+                Usage();
+        }
+    }
+    if (optind == argc) {
+        Usage();
+    }
+
+    int status = EXIT_SUCCESS;
+    for (int n = optind; n < argc; n++) {
+        std::string log = argv[n];
+        std::string spool = mountwrapper::SpoolPath(dir, log);
+        size_t bytes;
+        size_t records = CountRecords(spool, &bytes);
+        std::cout << log << ": " << records << " records, " << bytes
+                  << " bytes spooled in " << spool << "\n";
+        if (!replay || bytes == 0) {
+            continue;
+        }
+        int logfd = open(log.c_str(),
+                         O_CREAT | O_WRONLY | O_APPEND | O_CLOEXEC, 0644);
+        int err = logfd == -1 ? errno
+                              : mountwrapper::ReplaySpool(spool, logfd,
+                                                          &bytes);
+        if (logfd != -1) {
+            (void)close(logfd);
+        }
+        if (err != 0) {
+            std::cerr << progname << ": " << log << ": " << strerror(err)
+                      << "\n";
+            status = EXIT_FAILURE;
+            continue;
+        }
+        std::cout << log << ": moved " << bytes << " bytes\n";
+    }
+    return status;
+}
@@ -0,0 +1,198 @@
+/**
+ * @file nfsstats.cc
+ * @brief NFS RPC counter deltas for NFS mounts. See nfsstats.h.
+ *
+ * A mountstats stanza looks like
+ *
+ *   device 10.0.0.5:/export mounted on /mnt/x with fstype nfs4 statvers=1.1
+ *           opts:   rw,vers=4.1,...
+ *           ...
+ *           per-op statistics
+ *                   NULL: 1 1 0 44 24 0 0 0 0
+ *                GETATTR: 12 12 0 2304 2688 0 7 8 0
+ *
+ * where the op counters are ops, transmissions, timeouts, bytes sent and
+ * received, and cumulative queue, RTT and execute milliseconds (and, on
+ * newer kernels, errors). Only stanzas of interest get more than a glance
+ * at their first word.
+ */
+
+#include "nfsstats.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace mountwrapper {
+
+namespace {
+
+constexpr char kMountstatsFile[] = "/proc/self/mountstats";
+
+// NULL is the server ping; the rest are what mounting (v3 and v4) does
+// once the MOUNT protocol or session setup has found the export.
+constexpr const char* kOps[] = {
+    "NULL",        "GETATTR",        "LOOKUP",          "LOOKUP_ROOT",
+    "FSINFO",      "PATHCONF",       "FSSTAT",          "SERVER_CAPS",
+    "EXCHANGE_ID", "CREATE_SESSION", "SECINFO_NO_NAME", "SECINFO",
+};
+
+bool IsNfsType(const std::string& types) {
+    std::istringstream ss(types);
+    std::string type;
+    while (std::getline(ss, type, ',')) {
+        if (type == "nfs" || type == "nfs4") {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IsNfsInvocation(const mw_invocation* inv) {
+    auto slash = inv->binary.rfind('/');
+    std::string name = inv->binary.substr(slash == std::string::npos
+                                              ? 0
+                                              : slash + 1);
+    if (name.rfind("mount.nfs", 0) == 0 || name.rfind("umount.nfs", 0) == 0) {
+        return true;
+    }
+    for (size_t n = 1; n < inv->arg.size(); n++) {
+        const auto& a = inv->arg[n];
+        if ((a == "-t" || a == "--types") && n + 1 < inv->arg.size()) {
+            if (IsNfsType(inv->arg[n + 1])) {
+                return true;
+            }
+        } else if (a.rfind("-t", 0) == 0 && a.size() > 2 && a[2] != '-') {
+            if (IsNfsType(a.substr(2))) {
+                return true;
+            }
+        } else if (a.rfind("--types=", 0) == 0) {
+            if (IsNfsType(a.substr(8))) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Whether a "device ..." line starts a stanza we want.
+bool Matches(const mw_invocation* inv, const std::string& line) {
+    static const std::string kDevice = "device ";
+    static const std::string kOn = " mounted on ";
+    static const std::string kType = " with fstype nfs";
+    auto on = line.find(kOn);
+    auto type = line.find(kType);
+    if (on == std::string::npos || type == std::string::npos || type < on) {
+        return false;
+    }
+    if (!inv->nfs_server.empty()) {
+        return line.compare(kDevice.size(), inv->nfs_server.size() + 1,
+                            inv->nfs_server + ":") == 0;
+    }
+    std::string mountpoint =
+        line.substr(on + kOn.size(), type - on - kOn.size());
+    for (const auto& m : inv->nfs_mountpoints) {
+        if (m == mountpoint) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Sum the counters of the stanzas of interest. Returns how many there were.
+int Snapshot(const mw_invocation* inv,
+             std::map<std::string, NfsOpCounters>& counters) {
+    std::ifstream in(kMountstatsFile);
+    std::string line;
+    bool inside = false;
+    int mounts = 0;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 7, "device ") == 0) {
+            inside = Matches(inv, line);
+            mounts += inside;
+            continue;
+        }
+        if (!inside) {
+            continue;
+        }
+        size_t start = line.find_first_not_of(" \t");
+        size_t colon = line.find(':', start);
+        if (start == std::string::npos || colon == std::string::npos) {
+            continue;
+        }
+        std::string op = line.substr(start, colon - start);
+        bool wanted = false;
+        for (const char* k : kOps) {
+            wanted = wanted || op == k;
+        }
+        if (!wanted) {
+            continue;
+        }
+        std::istringstream fields(line.substr(colon + 1));
+        uint64_t ops, trans, timeouts, sent, received, queue, rtt, execute;
+        if (fields >> ops >> trans >> timeouts >> sent >> received >> queue >>
+            rtt >> execute) {
+            auto& c = counters[op];
+            c.ops += ops;
+            c.rtt_ms += rtt;
+            c.execute_ms += execute;
+        }
+    }
+    return mounts;
+}
+
+}  // namespace
+
+void NfsStatsBefore(mw_invocation* inv) {
+    if (!IsNfsInvocation(inv) || GetOption(inv, "nfs_stats", "1") == "0") {
+        return;
+    }
+    // The server from a server:/export (or [v6addr]:/export) source, or
+    // failing that, the absolute paths as possible mount points.
+    for (size_t n = 1; n < inv->arg.size(); n++) {
+        const auto& a = inv->arg[n];
+        if (a.empty()) {
+            continue;
+        }
+        auto sep = a.find(":/");
+        if (sep != std::string::npos && sep > 0 && a[0] != '-') {
+            inv->nfs_server = a.substr(0, sep);
+            break;
+        }
+        if (a[0] == '/') {
+            inv->nfs_mountpoints.push_back(a);
+        }
+    }
+    if (!inv->nfs_server.empty()) {
+        inv->nfs_mountpoints.clear();
+    } else if (inv->nfs_mountpoints.empty()) {
+        return;
+    }
+    Snapshot(inv, inv->nfs_before);
+}
+
+std::string NfsStatsAfter(mw_invocation* inv) {
+    if (inv->nfs_server.empty() && inv->nfs_mountpoints.empty()) {
+        return "";
+    }
+    std::map<std::string, NfsOpCounters> after;
+    int mounts = Snapshot(inv, after);
+    std::ostringstream ss;
+    ss << " nfs:[";
+    if (!inv->nfs_server.empty()) {
+        ss << "server=" << inv->nfs_server << ",";
+    }
+    ss << "mounts=" << mounts;
+    // ops/rtt_ms/execute_ms for each op that ran.
+    for (const auto& [op, c] : after) {
+        const auto& b = inv->nfs_before[op];
+        if (c.ops > b.ops) {
+            ss << "," << op << "=" << c.ops - b.ops << "/"
+               << c.rtt_ms - b.rtt_ms << "/" << c.execute_ms - b.execute_ms;
+        }
+    }
+    ss << "]";
+    return ss.str();
+}
+
+}  // namespace mountwrapper
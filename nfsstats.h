@@ -0,0 +1,33 @@
+/**
+ * @file nfsstats.h
+ * @brief NFS RPC counter deltas for NFS mounts, from /proc/self/mountstats.
+ *
+ * An invocation is taken to be an NFS one if the wrapped binary is
+ * mount.nfs* or umount.nfs*, or its arguments have -t (or --types) nfs or
+ * nfs4. For those, the per-op counters of the existing NFS mounts from the
+ * same server (those whose device is server:/...), or for an unmount, of
+ * the mount points named, are summed before the fork and again after the
+ * child exits, and the differences for the ops that matter to mounting are
+ * logged. A mount that didn't exist before counts in full. Other
+ * invocations never read mountstats.
+ */
+
+#ifndef NFSSTATS_H
+#define NFSSTATS_H
+
+#include <string>
+
+#include "mwinternal.h"
+
+namespace mountwrapper {
+
+// Before the fork: if it's an NFS invocation (and the "nfs_stats" option
+// isn't 0), take the first snapshot.
+void NfsStatsBefore(mw_invocation* inv);
+
+// After the child exits: the deltas as a " nfs:[...]" field, or "".
+std::string NfsStatsAfter(mw_invocation* inv);
+
+}  // namespace mountwrapper
+
+#endif  // NFSSTATS_H
@@ -0,0 +1,19 @@
+/**
+ * @file pgo_stub.cc
+ * @brief A stand-in for mount(8) when training and timing the wrapper.
+ *
+ * Exits at once, so that what's measured is the wrapper: with status 32
+ * (mount's "mount failure") if any argument is "fail", so the failure paths
+ * get trained too, and otherwise 0.
+ */
+
+#include <cstring>
+
+int main(int argc, char* argv[]) {
+    for (int n = 1; n < argc; n++) {
+        if (strcmp(argv[n], "fail") == 0) {
+            return 32;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,112 @@
+#!/bin/bash
+#
+# The representative workload for the PGO build (make pgo), and the timing
+# comparison of the builds it makes.
+#
+# Usage: pgo_workload.sh [-r runs] stub wrapper...
+#
+# Runs each wrapper 'runs' times (default 1000) with WRAPPER_BINARY set to
+# 'stub', cycling through mount-like command lines (ext4 and NFS mounts,
+# bind mounts, unmounts, a long option list and a failure) and environments
+# (a bare one, a kubelet-like one and one of 1000 variables), then prints
+# for each wrapper the wall time per run, the wrapper's own time per run
+# (the sum of its overhead_ns:[...] phases) and the startup time per run:
+# what's left once those and the stub's run are taken out, which is the
+# exec, startup and exit of env(1) and the wrapper. With more than one
+# wrapper, each is also compared with the first.
+
+set -eu
+
+runs=1000
+if [ "${1:-}" = "-r" ]; then
+    runs=$2
+    shift 2
+fi
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 [-r runs] stub wrapper..." >&2
+    exit 1
+fi
+for binary in "$@"; do
+    if [ ! -x "$binary" ]; then
+        echo "$0: $binary isn't executable" >&2
+        exit 1
+    fi
+done
+stub=$(realpath "$1")
+shift
+
+pvc=pvc-4f1c2a9e-6b1d-4d38-9a55-0e8e2b7c3d11
+pod=/var/lib/kubelet/pods/8d3e1f0a-2b4c-4e6d-8f1a-3c5e7d9b1f2a
+argv_sets=(
+    "-t ext4 -o rw,relatime,discard /dev/sdb1 $pod/volumes/kubernetes.io~csi/$pvc/mount"
+    "$pod/volumes/kubernetes.io~csi/$pvc/mount"
+    "--bind /var/lib/storageos/volumes/v.1 $pod/volumes/$pvc"
+    "-t nfs -o vers=4.1,hard,timeo=600,retrans=2,noresvport 10.0.0.5:/export/$pvc /mnt/$pvc"
+    "-t ext4 -o $(seq -s, -f 'opt%g' 100) /dev/sdc /mnt/long"
+    "-t ext4 fail /dev/sdd /mnt/fail"
+)
+
+env_sets=(
+    "PATH=/usr/sbin:/usr/bin:/sbin:/bin HOME=/root"
+    "$(for n in $(seq 60); do
+        printf 'KUBE_VAR_%d=%s ' "$n" "value-$n-$(printf '%040d' "$n")"
+    done)PATH=/usr/sbin:/usr/bin LANG=C.UTF-8"
+    "$(for n in $(seq 1000); do printf 'BIG_%d=%d ' "$n" "$n"; done)"
+)
+
+# Prints "wall_ns overhead_ns" per run for one wrapper.
+measure() {
+    local wrapper log start end
+    wrapper=$(realpath "$1")
+    log=$(mktemp -d)/mountwrapper.log
+    start=$(date +%s%N)
+    for ((i = 0; i < runs; i++)); do
+        # Word splitting of the sets is intended.
+        # shellcheck disable=SC2086
+        env -i ${env_sets[i % ${#env_sets[@]}]} \
+            WRAPPER_OUTPUT="$log" WRAPPER_BINARY="$stub" \
+            "$wrapper" ${argv_sets[i % ${#argv_sets[@]}]} || true
+    done
+    end=$(date +%s%N)
+    awk -v runs="$runs" -v wall=$((end - start)) '
+        / completed / && match($0, /overhead_ns:\[[^]]*\]/) {
+            n = split(substr($0, RSTART + 13, RLENGTH - 14), f, ",")
+            for (i = 1; i <= n; i++) {
+                split(f[i], kv, "=")
+                overhead += kv[2]
+                if (kv[1] == "fork") {
+                    fork += kv[2]
+                }
+            }
+            if (match($0, / latency_ns=[0-9]+/)) {
+                latency += substr($0, RSTART + 12, RLENGTH - 12)
+            }
+        }
+        # The latency runs from just before the fork, so it includes it.
+        END {
+            printf "%d %d %d\n", wall / runs, overhead / runs,
+                (wall - overhead - latency + fork) / runs
+        }' "$log"
+    rm -r "$(dirname "$log")"
+}
+
+printf '%-32s %12s %12s %12s\n' wrapper wall/run wrapper/run startup/run
+first=()
+for wrapper in "$@"; do
+    read -r wall overhead startup < <(measure "$wrapper")
+    printf '%-32s %10dus %10dus %10dus\n' "$wrapper" $((wall / 1000)) \
+        $((overhead / 1000)) $((startup / 1000))
+    if [ ${#first[@]} -eq 0 ]; then
+        first=("$wall" "$overhead" "$startup")
+    else
+        awk -v a="${first[*]}" -v b="$wall $overhead $startup" 'BEGIN {
+            split(a, x, " ")
+            split(b, y, " ")
+            printf "%-32s", "  change"
+            for (i = 1; i <= 3; i++) {
+                printf " %+11.1f%%", x[i] ? 100 * (y[i] - x[i]) / x[i] : 0
+            }
+            printf "\n"
+        }'
+    fi
+done
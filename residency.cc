@@ -0,0 +1,373 @@
+/**
+ * @file residency.cc
+ * @brief Page cache residency of the wrapped binary's exec file set. See
+ * residency.h.
+ *
+ * Residency is measured by mapping each file and asking mincore() which of
+ * its pages are in the page cache, which touches none of them. The file
+ * set cache is a small table of seqlocked entries indexed by a hash of the
+ * binary's device and inode; a wrapper that finds its entry being written,
+ * or can't claim one, just resolves the set itself.
+ */
+
+#include "residency.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shm.h"
+
+namespace mountwrapper {
+
+namespace {
+
+constexpr char kExecFilesBlockName[] = "/mountwrapper-execfiles-v1";
+constexpr size_t kExecFilesEntries = 32;
+constexpr size_t kExecFilesSize = 4000;  // NUL-separated paths.
+constexpr size_t kMaxExecFiles = 64;
+constexpr size_t kMaxStrtab = 1 << 20;
+
+#if defined(__x86_64__)
+#define MULTIARCH "x86_64-linux-gnu"
+#elif defined(__aarch64__)
+#define MULTIARCH "aarch64-linux-gnu"
+#endif
+
+constexpr const char* kDefaultLibDirs[] = {
+#ifdef MULTIARCH
+    "/lib/" MULTIARCH, "/usr/lib/" MULTIARCH,
+#endif
+    "/lib64",          "/usr/lib64",
+    "/lib",            "/usr/lib",
+};
+
+struct ExecFilesEntry {
+    std::atomic<uint32_t> seq;
+    uint32_t length;
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_ns;
+    char files[kExecFilesSize];
+};
+
+struct ExecFilesTable {
+    ExecFilesEntry entries[kExecFilesEntries];
+};
+
+struct FileKey {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_ns;
+};
+
+bool GetFileKey(const std::string& path, FileKey& key) {
+    struct stat st;
+    if (stat(path.c_str(), &st) == -1) {
+        return false;
+    }
+    key.dev = st.st_dev;
+    key.ino = st.st_ino;
+    key.mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    return true;
+}
+
+bool ReadAt(int fd, void* buf, size_t len, uint64_t offset) {
+    return pread(fd, buf, len, offset) == static_cast<ssize_t>(len);
+}
+
+// The interpreter, DT_NEEDED names and library search path of an ELF64
+// file. Returns false for anything that isn't one (32-bit included), which
+// leaves just the file itself in the set.
+bool ReadDynamic(const std::string& path,
+                 std::string& interp,
+                 std::vector<std::string>& needed,
+                 std::vector<std::string>& search) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    std::vector<Elf64_Phdr> phdrs;
+    std::vector<Elf64_Dyn> dyns;
+    Elf64_Ehdr ehdr;
+    bool ok = ReadAt(fd, &ehdr, sizeof(ehdr), 0) &&
+              memcmp(ehdr.e_ident, ELFMAG, SELFMAG) == 0 &&
+              ehdr.e_ident[EI_CLASS] == ELFCLASS64 &&
+              ehdr.e_phentsize == sizeof(Elf64_Phdr);
+    if (ok) {
+        phdrs.resize(ehdr.e_phnum);
+        ok = ReadAt(fd, phdrs.data(), phdrs.size() * sizeof(Elf64_Phdr),
+                    ehdr.e_phoff);
+    }
+    for (const auto& ph : phdrs) {
+        if (!ok) {
+            break;
+        }
+        if (ph.p_type == PT_INTERP && ph.p_filesz < 4096) {
+            interp.resize(ph.p_filesz);
+            ok = ReadAt(fd, &interp[0], interp.size(), ph.p_offset);
+            interp.resize(strnlen(interp.c_str(), interp.size()));
+        } else if (ph.p_type == PT_DYNAMIC && ph.p_filesz < (1 << 16)) {
+            dyns.resize(ph.p_filesz / sizeof(Elf64_Dyn));
+            ok = ReadAt(fd, dyns.data(), dyns.size() * sizeof(Elf64_Dyn),
+                        ph.p_offset);
+        }
+    }
+
+    // DT_STRTAB is an address; find its place in the file from the
+    // segment that loads it.
+    uint64_t strtab = 0;
+    uint64_t strsz = 0;
+    for (const auto& dyn : dyns) {
+        if (dyn.d_tag == DT_STRTAB) {
+            strtab = dyn.d_un.d_ptr;
+        } else if (dyn.d_tag == DT_STRSZ) {
+            strsz = dyn.d_un.d_val;
+        }
+    }
+    std::string strings;
+    for (const auto& ph : phdrs) {
+        if (ok && strsz > 0 && strsz <= kMaxStrtab &&
+            ph.p_type == PT_LOAD && strtab >= ph.p_vaddr &&
+            strtab + strsz <= ph.p_vaddr + ph.p_filesz) {
+            strings.resize(strsz);
+            ok = ReadAt(fd, &strings[0], strsz,
+                        ph.p_offset + (strtab - ph.p_vaddr));
+            break;
+        }
+    }
+    (void)close(fd);
+    if (!ok) {
+        return false;
+    }
+
+    auto str = [&](uint64_t offset) {
+        return offset < strings.size() ? std::string(strings.c_str() + offset)
+                                       : std::string();
+    };
+    std::string origin = path.substr(0, path.rfind('/'));
+    std::vector<std::string> rpath;
+    std::vector<std::string> runpath;
+    for (const auto& dyn : dyns) {
+        if (dyn.d_tag == DT_NEEDED) {
+            needed.push_back(str(dyn.d_un.d_val));
+        } else if (dyn.d_tag == DT_RPATH || dyn.d_tag == DT_RUNPATH) {
+            auto& dirs = dyn.d_tag == DT_RPATH ? rpath : runpath;
+            std::string list = str(dyn.d_un.d_val);
+            size_t start = 0;
+            while (start <= list.size()) {
+                size_t end = std::min(list.find(':', start), list.size());
+                std::string dir = list.substr(start, end - start);
+                for (const char* o : {"${ORIGIN}", "$ORIGIN"}) {
+                    size_t at = dir.find(o);
+                    if (at != std::string::npos) {
+                        dir.replace(at, strlen(o), origin);
+                    }
+                }
+                if (!dir.empty()) {
+                    dirs.push_back(dir);
+                }
+                start = end + 1;
+            }
+        }
+    }
+    // As ld.so does, DT_RPATH only counts if there's no DT_RUNPATH.
+    search = runpath.empty() ? rpath : runpath;
+    return true;
+}
+
+std::string FindLibrary(const std::string& name,
+                        const std::vector<std::string>& search) {
+    if (name.find('/') != std::string::npos) {
+        return name;
+    }
+    for (const auto& dir : search) {
+        std::string path = dir + "/" + name;
+        if (access(path.c_str(), R_OK) == 0) {
+            return path;
+        }
+    }
+    for (const char* dir : kDefaultLibDirs) {
+        std::string path = std::string(dir) + "/" + name;
+        if (access(path.c_str(), R_OK) == 0) {
+            return path;
+        }
+    }
+    return "";
+}
+
+std::vector<std::string> ResolveExecFiles(const std::string& binary) {
+    std::vector<std::string> files = {binary};
+    std::set<std::string> seen = {binary};
+    for (size_t n = 0; n < files.size() && files.size() < kMaxExecFiles;
+         n++) {
+        std::string interp;
+        std::vector<std::string> needed;
+        std::vector<std::string> search;
+        if (!ReadDynamic(files[n], interp, needed, search)) {
+            continue;
+        }
+        if (!interp.empty()) {
+            needed.insert(needed.begin(), interp);
+        }
+        for (const auto& name : needed) {
+            std::string path = FindLibrary(name, search);
+            if (!path.empty() && seen.insert(path).second &&
+                files.size() < kMaxExecFiles) {
+                files.push_back(path);
+            }
+        }
+    }
+    return files;
+}
+
+ExecFilesEntry* FindEntry(const FileKey& key) {
+    auto table = static_cast<ExecFilesTable*>(
+        MapSharedBlock(kExecFilesBlockName, sizeof(ExecFilesTable)));
+    if (table == nullptr) {
+        return nullptr;
+    }
+    uint64_t h = (key.dev * 1099511628211ULL) ^ key.ino;
+    return &table->entries[h % kExecFilesEntries];
+}
+
+bool ReadEntry(const ExecFilesEntry& entry,
+               const FileKey& key,
+               std::vector<std::string>& files) {
+    for (int tries = 0; tries < 100; tries++) {
+        uint32_t before = entry.seq.load(std::memory_order_acquire);
+        if (before == 0) {
+            return false;
+        }
+        if (before & 1) {
+            continue;
+        }
+        FileKey found = {entry.dev, entry.ino, entry.mtime_ns};
+        char buf[kExecFilesSize];
+        uint32_t length = std::min<uint32_t>(entry.length, sizeof(buf));
+        memcpy(buf, entry.files, length);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (entry.seq.load(std::memory_order_relaxed) != before) {
+            continue;
+        }
+        if (found.dev != key.dev || found.ino != key.ino ||
+            found.mtime_ns != key.mtime_ns) {
+            return false;
+        }
+        files.clear();
+        for (size_t start = 0; start < length;) {
+            size_t len = strnlen(buf + start, length - start);
+            files.emplace_back(buf + start, len);
+            start += len + 1;
+        }
+        return !files.empty();
+    }
+    return false;
+}
+
+void WriteEntry(ExecFilesEntry& entry,
+                const FileKey& key,
+                const std::vector<std::string>& files) {
+    std::string buf;
+    for (const auto& f : files) {
+        if (buf.size() + f.size() + 1 > kExecFilesSize) {
+            break;
+        }
+        buf += f;
+        buf += '\0';
+    }
+    // Claim the entry by making its sequence odd; if someone else has it,
+    // let them have it.
+    uint32_t seq = entry.seq.load(std::memory_order_relaxed);
+    if ((seq & 1) || !entry.seq.compare_exchange_strong(
+                         seq, seq + 1, std::memory_order_relaxed)) {
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    entry.dev = key.dev;
+    entry.ino = key.ino;
+    entry.mtime_ns = key.mtime_ns;
+    entry.length = buf.size();
+    memcpy(entry.files, buf.data(), buf.size());
+    entry.seq.store(seq + 2, std::memory_order_release);
+}
+
+}  // namespace
+
+std::vector<std::string> ExecFiles(const std::string& binary) {
+    FileKey key;
+    if (!GetFileKey(binary, key)) {
+        return {};
+    }
+    std::vector<std::string> files;
+    auto entry = FindEntry(key);
+    if (entry != nullptr && ReadEntry(*entry, key, files)) {
+        return files;
+    }
+    files = ResolveExecFiles(binary);
+    if (entry != nullptr) {
+        WriteEntry(*entry, key, files);
+    }
+    return files;
+}
+
+bool FileResidency(const std::string& path, uint64_t& pages, uint64_t& cold) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    (void)close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    size_t page = sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> vec((st.st_size + page - 1) / page);
+    bool ok = mincore(map, st.st_size, vec.data()) == 0;
+    (void)munmap(map, st.st_size);
+    if (!ok) {
+        return false;
+    }
+    pages += vec.size();
+    for (unsigned char v : vec) {
+        cold += !(v & 1);
+    }
+    return true;
+}
+
+std::string ExecResidency(const mw_invocation* inv) {
+    if (GetOption(inv, "exec_residency", "1") == "0") {
+        return "";
+    }
+    uint64_t files = 0;
+    uint64_t pages = 0;
+    uint64_t cold = 0;
+    for (const auto& path : ExecFiles(inv->binary)) {
+        files += FileResidency(path, pages, cold);
+    }
+    if (pages == 0) {
+        return "";
+    }
+    char ratio[16];
+    snprintf(ratio, sizeof(ratio), "%.3f",
+             static_cast<double>(cold) / pages);
+    return " exec_cache:[files=" + std::to_string(files) +
+           ",pages=" + std::to_string(pages) +
+           ",cold=" + std::to_string(cold) + ",cold_ratio=" + ratio + "]";
+}
+
+}  // namespace mountwrapper
@@ -0,0 +1,38 @@
+/**
+ * @file residency.h
+ * @brief Page cache residency of the files an exec of the wrapped binary
+ * maps, to tell exec cold starts from slow mounts.
+ *
+ * The file set is the binary, its ELF interpreter and its DT_NEEDED
+ * libraries, transitively. Libraries are looked for in DT_RPATH,
+ * DT_RUNPATH ($ORIGIN expanded) and the default directories; ld.so.cache
+ * and LD_LIBRARY_PATH aren't consulted. Resolving the set means reading
+ * ELF headers, so it's cached in shared memory by the binary's device,
+ * inode and mtime, and only redone when the binary changes.
+ */
+
+#ifndef RESIDENCY_H
+#define RESIDENCY_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mwinternal.h"
+
+namespace mountwrapper {
+
+// The files exec'ing 'binary' maps, the binary first. Empty if the binary
+// can't be opened.
+std::vector<std::string> ExecFiles(const std::string& binary);
+
+// Count a file's pages and how many of them aren't in the page cache.
+bool FileResidency(const std::string& path, uint64_t& pages, uint64_t& cold);
+
+// The execute record's " exec_cache:[...]" field for the wrapped binary,
+// or "" if the "exec_residency" option is 0 or nothing could be measured.
+std::string ExecResidency(const mw_invocation* inv);
+
+}  // namespace mountwrapper
+
+#endif  // RESIDENCY_H
@@ -0,0 +1,79 @@
+/**
+ * @file shm.cc
+ * @brief Named shared-memory blocks. See shm.h.
+ */
+
+#include "shm.h"
+
+#include <map>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mountwrapper {
+
+// Shared-memory objects are readable by viewers running as other users, but
+// only writable by the (normally root) wrappers.
+static constexpr mode_t kSharedBlockMode = 0644;
+
+// Whether a block is one that only 'owner' (or root, if 'root_ok') could
+// have written.
+static bool Trusted(const struct stat& st, uid_t owner, bool root_ok) {
+    return S_ISREG(st.st_mode) && (st.st_mode & (S_IWGRP | S_IWOTH)) == 0 &&
+           (st.st_uid == owner || (root_ok && st.st_uid == 0));
+}
+
+void* MapSharedBlock(const std::string& name, size_t size) {
+    static std::mutex cache_mutex;
+    static std::map<std::string, void*> cache;
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = cache.find(name);
+    if (it != cache.end()) {
+        return it->second;
+    }
+
+    void* addr = nullptr;
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC,
+                      kSharedBlockMode);
+    if (fd != -1) {
+        // Only ever grow the object: ftruncate() zero-fills, and a racing
+        // creator asking for the same size is harmless.
+        struct stat st;
+        if (fstat(fd, &st) == 0 && Trusted(st, geteuid(), false) &&
+            (static_cast<size_t>(st.st_size) >= size ||
+             ftruncate(fd, size) == 0)) {
+            addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        fd, 0);
+            if (addr == MAP_FAILED) {
+                addr = nullptr;
+            }
+        }
+        (void)close(fd);
+    }
+    cache[name] = addr;
+    return addr;
+}
+
+const void* MapSharedBlockReadOnly(const std::string& name, size_t size) {
+    int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd == -1) {
+        return nullptr;
+    }
+    void* addr = nullptr;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && Trusted(st, geteuid(), true) &&
+        static_cast<size_t>(st.st_size) >= size) {
+        addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            addr = nullptr;
+        }
+    }
+    (void)close(fd);
+    return addr;
+}
+
+}  // namespace mountwrapper
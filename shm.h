@@ -0,0 +1,52 @@
+/**
+ * @file shm.h
+ * @brief Named shared-memory blocks shared by all wrappers on a node.
+ *
+ * Blocks live in POSIX shared memory (/dev/shm), so using them costs no
+ * filesystem I/O on the log's filesystem and takes no locks. A new block is
+ * zero-filled, so all-zero must be a valid initial state for anything kept
+ * in one; block names carry a layout version so a changed layout never
+ * meets an old one.
+ *
+ * Everything here is best-effort. If shared memory isn't available the
+ * mapping functions return nullptr and callers carry on without the
+ * feature, rather than failing the mount. The same goes for a block that
+ * someone else could have written: /dev/shm is world-writable, so anyone
+ * can create a block under our name first. Wrappers only use blocks they
+ * own themselves, and viewers only those owned by root or themselves, and
+ * never one that is group- or world-writable.
+ */
+
+#ifndef SHM_H
+#define SHM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace mountwrapper {
+
+// Map the named block read-write, creating it if necessary. Mappings are
+// cached, so repeated calls in one process are cheap.
+void* MapSharedBlock(const std::string& name, size_t size);
+
+// Map an existing block read-only, for viewers. Not cached.
+const void* MapSharedBlockReadOnly(const std::string& name, size_t size);
+
+// FNV-1a, used to key shared tables by strings such as binary paths. Never
+// returns 0, which tables use to mean 'free'.
+inline uint64_t HashKey(const std::string& str) {
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : str) {
+        h = (h ^ c) * 1099511628211ULL;
+    }
+    return h == 0 ? 1 : h;
+}
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "shared-memory tables need address-free 64-bit atomics");
+
+}  // namespace mountwrapper
+
+#endif  // SHM_H
@@ -0,0 +1,154 @@
+/**
+ * @file sketch.h
+ * @brief A small mergeable quantile sketch for latencies.
+ *
+ * Values are counted in logarithmically sized bins, so any quantile comes
+ * back within a fixed relative error (1% by default) however skewed the
+ * data, and two sketches merge exactly by adding their bins. A sketch of
+ * mount latencies spanning microseconds to minutes needs a few hundred bins
+ * at most.
+ */
+
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "varint.h"
+
+namespace mountwrapper {
+
+class LatencySketch {
+   public:
+    static constexpr double kDefaultAccuracy = 0.01;
+
+    explicit LatencySketch(double accuracy = kDefaultAccuracy)
+        : gamma_((1 + accuracy) / (1 - accuracy)),
+          log_gamma_(std::log(gamma_)) {}
+
+    void Add(int64_t value, uint64_t n = 1) {
+        if (n == 0) {
+            return;
+        }
+        if (count_ == 0 || value < min_) {
+            min_ = value;
+        }
+        if (count_ == 0 || value > max_) {
+            max_ = value;
+        }
+        count_ += n;
+        sum_ += static_cast<double>(value) * n;
+        if (value <= 0) {
+            zeros_ += n;
+        } else {
+            bins_[Index(value)] += n;
+        }
+    }
+
+    // Both sketches must have been made with the same accuracy.
+    void Merge(const LatencySketch& other) {
+        if (other.count_ == 0) {
+            return;
+        }
+        if (count_ == 0 || other.min_ < min_) {
+            min_ = other.min_;
+        }
+        if (count_ == 0 || other.max_ > max_) {
+            max_ = other.max_;
+        }
+        count_ += other.count_;
+        sum_ += other.sum_;
+        zeros_ += other.zeros_;
+        for (const auto& [index, n] : other.bins_) {
+            bins_[index] += n;
+        }
+    }
+
+    // The q-quantile (0 <= q <= 1), clamped to the exact min and max.
+    double Quantile(double q) const {
+        if (count_ == 0) {
+            return 0;
+        }
+        uint64_t rank = std::llround(q * (count_ - 1));
+        if (rank < zeros_) {
+            return std::min<int64_t>(0, max_);
+        }
+        uint64_t seen = zeros_;
+        for (const auto& [index, n] : bins_) {
+            seen += n;
+            if (seen > rank) {
+                // The midpoint (in relative terms) of the bin.
+                double value = 2 * std::pow(gamma_, index) / (gamma_ + 1);
+                return std::clamp<double>(value, min_, max_);
+            }
+        }
+        return max_;
+    }
+
+    uint64_t count() const { return count_; }
+    int64_t min() const { return min_; }
+    int64_t max() const { return max_; }
+    double mean() const { return count_ == 0 ? 0 : sum_ / count_; }
+
+    void Encode(std::string& out) const {
+        PutVarint(out, count_);
+        PutVarint(out, ZigZag(min_));
+        PutVarint(out, ZigZag(max_));
+        PutVarint(out, static_cast<uint64_t>(sum_));
+        PutVarint(out, zeros_);
+        PutVarint(out, bins_.size());
+        int32_t prev = 0;
+        for (const auto& [index, n] : bins_) {
+            PutVarint(out, ZigZag(index - prev));
+            PutVarint(out, n);
+            prev = index;
+        }
+    }
+
+    bool Decode(VarintReader& r) {
+        *this = LatencySketch(Accuracy());
+        uint64_t min, max, sum, nbins;
+        if (!r.Varint(count_) || !r.Varint(min) || !r.Varint(max) ||
+            !r.Varint(sum) || !r.Varint(zeros_) || !r.Varint(nbins)) {
+            return false;
+        }
+        min_ = UnZigZag(min);
+        max_ = UnZigZag(max);
+        sum_ = sum;
+        int32_t index = 0;
+        for (uint64_t b = 0; b < nbins; b++) {
+            uint64_t delta, n;
+            if (!r.Varint(delta) || !r.Varint(n)) {
+                return false;
+            }
+            index += UnZigZag(delta);
+            bins_[index] = n;
+        }
+        return true;
+    }
+
+   private:
+    double Accuracy() const { return (gamma_ - 1) / (gamma_ + 1); }
+
+    int32_t Index(int64_t value) const {
+        return static_cast<int32_t>(
+            std::ceil(std::log(static_cast<double>(value)) / log_gamma_));
+    }
+
+    double gamma_;
+    double log_gamma_;
+    uint64_t count_ = 0;
+    int64_t min_ = 0;
+    int64_t max_ = 0;
+    double sum_ = 0;
+    uint64_t zeros_ = 0;
+    std::map<int32_t, uint64_t> bins_;
+};
+
+}  // namespace mountwrapper
+
+#endif  // SKETCH_H
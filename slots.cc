@@ -0,0 +1,175 @@
+/**
+ * @file slots.cc
+ * @brief Wrapper side of the in-flight slot table. See slots.h.
+ */
+
+#include "slots.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <signal.h>
+#include <unistd.h>
+
+#include "shm.h"
+
+namespace mountwrapper {
+
+static SlotTable* GetSlotTable(const mw_invocation* inv) {
+    if (GetOption(inv, "top", "1") == "0") {
+        return nullptr;
+    }
+    return static_cast<SlotTable*>(
+        MapSharedBlock(kSlotsBlockName, sizeof(SlotTable)));
+}
+
+static uint64_t SlotState(uint32_t phase, pid_t owner) {
+    return static_cast<uint64_t>(owner) << 32 | phase;
+}
+
+static uint32_t PhaseOf(uint64_t state) {
+    return static_cast<uint32_t>(state);
+}
+
+static pid_t OwnerOf(uint64_t state) {
+    return static_cast<pid_t>(state >> 32);
+}
+
+// Copy a string into a fixed field, truncating and always terminating.
+static void CopyField(char* dst, size_t size, const std::string& src) {
+    size_t len = std::min(src.size(), size - 1);
+    memcpy(dst, src.data(), len);
+    dst[len] = '\0';
+}
+
+static void WriteSlot(Slot& slot, const SlotData& data) {
+    uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+    slot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&slot.data, &data, sizeof(data));
+    slot.seq.store(seq + 2, std::memory_order_release);
+}
+
+bool ReadSlot(const Slot& slot, SlotData& data, uint32_t& phase) {
+    for (int tries = 0; tries < 100; tries++) {
+        uint32_t before = slot.seq.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        phase = PhaseOf(slot.state.load(std::memory_order_relaxed));
+        memcpy(&data, &slot.data, sizeof(data));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) == before) {
+            return phase != kPhaseFree && phase != kPhaseClaimed;
+        }
+    }
+    return false;
+}
+
+// Claim a slot in the given state, naming ourselves as its owner in the
+// same CAS, so there's no moment at which it's taken but by nobody.
+static bool TryClaim(Slot& slot, uint64_t expected) {
+    return slot.state.compare_exchange_strong(
+        expected, SlotState(kPhaseClaimed, getpid()),
+        std::memory_order_acquire);
+}
+
+void SlotRegister(mw_invocation* inv) {
+    auto table = GetSlotTable(inv);
+    if (table == nullptr) {
+        return;
+    }
+
+    // Start looking at a pid-dependent place so concurrent wrappers don't
+    // all fight over the first slot.
+    size_t start = static_cast<size_t>(getpid()) % kInflightSlots;
+    int claimed = -1;
+    for (size_t n = 0; n < kInflightSlots && claimed == -1; n++) {
+        size_t i = (start + n) % kInflightSlots;
+        if (TryClaim(table->inflight[i], SlotState(kPhaseFree, 0))) {
+            claimed = i;
+        }
+    }
+    if (claimed == -1) {
+        // Full. Take over a slot left behind by a wrapper that died, even
+        // one that died before it got to fill the slot in.
+        for (size_t i = 0; i < kInflightSlots && claimed == -1; i++) {
+            auto& slot = table->inflight[i];
+            uint64_t state = slot.state.load(std::memory_order_relaxed);
+            if (PhaseOf(state) != kPhaseFree && OwnerOf(state) > 0 &&
+                kill(OwnerOf(state), 0) == -1 && errno == ESRCH &&
+                TryClaim(slot, state)) {
+                claimed = i;
+            }
+        }
+    }
+    if (claimed == -1) {
+        return;
+    }
+
+    SlotData data{};
+    data.wrapper_pid = getpid();
+    data.child_pid = -1;
+    data.start_ns = MonotonicNs();
+    CopyField(data.runtimestamp, sizeof(data.runtimestamp),
+              inv->runtimestamp);
+    CopyField(data.binary, sizeof(data.binary), inv->binary);
+    std::string args;
+    for (size_t n = 1; n < inv->arg.size(); n++) {
+        args += (n > 1 ? " " : "") + inv->arg[n];
+    }
+    CopyField(data.args, sizeof(data.args), args);
+
+    auto& slot = table->inflight[claimed];
+    WriteSlot(slot, data);
+    slot.state.store(SlotState(kPhaseSpawning, data.wrapper_pid),
+                     std::memory_order_release);
+    inv->slot = claimed;
+}
+
+void SlotSetPhase(mw_invocation* inv, SlotPhase phase) {
+    if (inv->slot == -1) {
+        return;
+    }
+    auto table = GetSlotTable(inv);
+    auto& slot = table->inflight[inv->slot];
+    if (phase == kPhaseRunning) {
+        SlotData data = slot.data;
+        data.child_pid = inv->pid;
+        data.start_ns = inv->spawn_ns;
+        WriteSlot(slot, data);
+    }
+    slot.state.store(SlotState(phase, getpid()), std::memory_order_release);
+}
+
+void SlotComplete(mw_invocation* inv, int32_t status) {
+    if (inv->slot == -1) {
+        return;
+    }
+    auto table = GetSlotTable(inv);
+    SlotData data = table->inflight[inv->slot].data;
+    data.end_ns = inv->exit_ns;
+    data.status = status;
+
+    // Readers may catch a recent slot while it's being overwritten; the
+    // seqlock tells them to look again.
+    uint64_t n = table->recent_next.fetch_add(1, std::memory_order_relaxed);
+    auto& slot = table->recent[n % kRecentSlots];
+    WriteSlot(slot, data);
+    slot.state.store(SlotState(kPhaseLogging, data.wrapper_pid),
+                     std::memory_order_release);
+}
+
+void SlotRelease(mw_invocation* inv) {
+    if (inv->slot == -1) {
+        return;
+    }
+    auto table = GetSlotTable(inv);
+    table->inflight[inv->slot].state.store(SlotState(kPhaseFree, 0),
+                                           std::memory_order_release);
+    inv->slot = -1;
+}
+
+}  // namespace mountwrapper
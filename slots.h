@@ -0,0 +1,79 @@
+/**
+ * @file slots.h
+ * @brief Shared-memory table of in-flight and recently completed
+ * invocations, written by every wrapper and read by mounttop.
+ *
+ * Each wrapper claims a free in-flight slot with a compare-and-swap when it
+ * spawns, updates its phase as it goes, and frees the slot once it has
+ * logged. The claim records the wrapper's pid along with the phase, so
+ * when the table is full, slots of wrappers that died at any point after
+ * claiming one are taken over. Completions are also pushed onto a small
+ * ring of recent runs. Slot contents are published under a per-slot
+ * sequence counter (a seqlock) so readers can take consistent copies
+ * without blocking writers. None of this touches a filesystem.
+ */
+
+#ifndef SLOTS_H
+#define SLOTS_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "mwinternal.h"
+
+namespace mountwrapper {
+
+static constexpr char kSlotsBlockName[] = "/mountwrapper-slots-v2";
+static constexpr size_t kInflightSlots = 256;
+static constexpr size_t kRecentSlots = 64;
+static constexpr size_t kSlotBinaryLength = 64;
+static constexpr size_t kSlotArgsLength = 160;
+
+enum SlotPhase : uint32_t {
+    kPhaseFree = 0,
+    kPhaseClaimed,  // Being filled in.
+    kPhaseSpawning,
+    kPhaseRunning,
+    kPhaseLogging,
+};
+
+// The data part of a slot, copied in and out whole.
+struct SlotData {
+    int32_t wrapper_pid;
+    int32_t child_pid;
+    int64_t start_ns;  // CLOCK_MONOTONIC at spawn.
+    int64_t end_ns;    // CLOCK_MONOTONIC at exit (recent runs only).
+    int32_t status;    // Exit code, or -signal (recent runs only).
+    char runtimestamp[24];
+    char binary[kSlotBinaryLength];
+    char args[kSlotArgsLength];  // Space-separated, argv[0] omitted.
+};
+
+struct alignas(64) Slot {
+    // SlotPhase in the low half and the owning wrapper's pid in the high
+    // half; claimed by CAS from free (0).
+    std::atomic<uint64_t> state;
+    std::atomic<uint32_t> seq;  // Odd while the data is being written.
+    SlotData data;
+};
+
+struct SlotTable {
+    Slot inflight[kInflightSlots];
+    std::atomic<uint64_t> recent_next;  // Total completions ever pushed.
+    Slot recent[kRecentSlots];
+};
+
+// Take a consistent copy of a slot's data. Returns false if a writer kept
+// it busy, or the slot is free.
+bool ReadSlot(const Slot& slot, SlotData& data, uint32_t& phase);
+
+// Wrapper side; all no-ops if the table is unavailable or disabled by the
+// "top" option set to 0.
+void SlotRegister(mw_invocation* inv);
+void SlotSetPhase(mw_invocation* inv, SlotPhase phase);
+void SlotComplete(mw_invocation* inv, int32_t status);
+void SlotRelease(mw_invocation* inv);
+
+}  // namespace mountwrapper
+
+#endif  // SLOTS_H
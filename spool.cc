@@ -0,0 +1,248 @@
+/**
+ * @file spool.cc
+ * @brief The fallback spool for records that couldn't be logged. See
+ * spool.h.
+ */
+
+#include "spool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "shm.h"
+
+namespace mountwrapper {
+
+namespace {
+
+// An fd holding an exclusive lock on a spool, released with the fd.
+//
+// Spools live in world-writable directories and we're normally root, so
+// anyone could have put something under a spool's name first: a symlink to
+// a file of their choosing, for us to append to or truncate, or a file of
+// forged records for us to copy into the log. Only a regular file that is
+// ours alone will do.
+class LockedSpool {
+   public:
+    LockedSpool(const std::string& path, int flags) {
+        fd_ = open(path.c_str(), flags | O_NOFOLLOW | O_CLOEXEC, 0600);
+        if (fd_ == -1) {
+            error_ = errno;
+            return;
+        }
+        int ret;
+        if (fstat(fd_, &st_) == -1) {
+            error_ = errno;
+        } else if (!S_ISREG(st_.st_mode) || st_.st_uid != geteuid() ||
+                   (st_.st_mode & 077) != 0 || st_.st_nlink != 1) {
+            error_ = EPERM;
+        } else {
+            while ((ret = flock(fd_, LOCK_EX)) == -1 && errno == EINTR) {
+            }
+            // Someone may have written it while we waited.
+            error_ = ret == -1 || fstat(fd_, &st_) == -1 ? errno : 0;
+        }
+        if (error_ != 0) {
+            (void)close(fd_);
+            fd_ = -1;
+        }
+    }
+    ~LockedSpool() {
+        if (fd_ != -1) {
+            (void)close(fd_);
+        }
+    }
+
+    int fd() const { return fd_; }
+    // 0, or why there's no fd.
+    int error() const { return error_; }
+    // As it was once locked.
+    const struct stat& stat() const { return st_; }
+
+   private:
+    int fd_ = -1;
+    int error_ = 0;
+    struct stat st_ = {};
+};
+
+// Say why records couldn't be spooled, the first time it happens.
+void WarnSpoolFailed(const std::string& path, const std::string& why) {
+    static std::atomic<bool> warned{false};
+    if (!warned.exchange(true)) {
+        std::cerr << "Failed to spool records in " << path << ": " << why
+                  << "; dumping them to stdout\n";
+    }
+}
+
+}  // namespace
+
+std::string DefaultSpoolDir() {
+    struct stat st;
+    return stat(kDefaultSpoolDir, &st) == 0 && S_ISDIR(st.st_mode)
+               ? kDefaultSpoolDir
+               : kFallbackSpoolDir;
+}
+
+std::string SpoolPath(const std::string& dir, const std::string& logfile) {
+    char name[64];
+    snprintf(name, sizeof(name), "/mountwrapper-spool-%016llx",
+             static_cast<unsigned long long>(HashKey(logfile)));
+    return dir + name;
+}
+
+std::string SpoolPathFor(const mw_invocation* inv,
+                         const std::string& logfile) {
+    if (GetOption(inv, "spool", "1") == "0") {
+        return "";
+    }
+    std::string dir = GetOption(inv, "spool_dir", "");
+    return SpoolPath(dir.empty() ? DefaultSpoolDir() : dir, logfile);
+}
+
+bool SpoolRecords(const mw_invocation* inv,
+                  const std::string& logfile,
+                  const std::vector<std::string>& records,
+                  size_t first) {
+    std::string path = SpoolPathFor(inv, logfile);
+    if (path.empty() || first >= records.size()) {
+        return first >= records.size();
+    }
+    int flags = O_RDWR | O_CREAT | O_APPEND;
+    auto spool = std::make_unique<LockedSpool>(path, flags);
+    if (spool->error() == ENOENT) {
+        // A spool directory of our own that isn't there yet.
+        std::string dir = path.substr(0, path.rfind('/'));
+        if (mkdir(dir.c_str(), 0700) == 0 || errno == EEXIST) {
+            spool = std::make_unique<LockedSpool>(path, flags);
+        }
+    }
+    if (spool->fd() == -1) {
+        WarnSpoolFailed(path, strerror(spool->error()));
+        return false;
+    }
+    const struct stat& st = spool->stat();
+    size_t cap = SizeOption(inv, "spool_bytes", kDefaultSpoolBytes);
+    if (st.st_size == 0 && st.st_blocks == 0) {
+        // Reserve the lot now, while there's room, without changing the
+        // size. Best effort; not every filesystem can.
+        (void)fallocate(spool->fd(), FALLOC_FL_KEEP_SIZE, 0, cap);
+    }
+
+    static const char kNewline[] = "\n";
+    std::vector<struct iovec> iov;
+    size_t total = 0;
+    for (size_t n = first; n < records.size(); n++) {
+        iov.push_back({const_cast<char*>(records[n].data()),
+                       records[n].size()});
+        iov.push_back({const_cast<char*>(kNewline), 1});
+        total += records[n].size() + 1;
+    }
+    if (static_cast<size_t>(st.st_size) + total > cap) {
+        WarnSpoolFailed(path, "spool is full");
+        return false;
+    }
+    // We hold the lock, so even if it takes more than one writev(), nobody
+    // sees the records until they're all there.
+    size_t written = 0;
+    for (size_t n = 0; n < iov.size(); n += IOV_MAX) {
+        int count = std::min<size_t>(IOV_MAX, iov.size() - n);
+        ssize_t ret = writev(spool->fd(), &iov[n], count);
+        size_t expected = 0;
+        for (int i = 0; i < count; i++) {
+            expected += iov[n + i].iov_len;
+        }
+        if (ret != static_cast<ssize_t>(expected)) {
+            WarnSpoolFailed(path,
+                            ret == -1 ? strerror(errno) : "short write");
+            // Don't leave part of a record behind.
+            (void)ftruncate(spool->fd(), st.st_size);
+            return false;
+        }
+        written += expected;
+    }
+    return written == total;
+}
+
+int ReplaySpool(const std::string& spool_path, int logfd, size_t* bytes) {
+    if (bytes != nullptr) {
+        *bytes = 0;
+    }
+    // The usual case, with nothing spooled, costs one failed open().
+    LockedSpool spool(spool_path, O_RDWR);
+    if (spool.fd() == -1) {
+        return spool.error() == ENOENT ? 0 : spool.error();
+    }
+    const struct stat& st = spool.stat();
+    if (st.st_size == 0) {
+        return 0;
+    }
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, spool.fd(),
+                     0);
+    if (map == MAP_FAILED) {
+        return errno;
+    }
+    const char* data = static_cast<const char*>(map);
+    // Replay whole records only. We hold the lock, so a spool that doesn't
+    // end in a newline was torn by a wrapper that died appending to it,
+    // and the record it was writing can't be finished.
+    size_t whole = st.st_size;
+    while (whole > 0 && data[whole - 1] != '\n') {
+        whole--;
+    }
+    ssize_t ret = 0;
+    if (whole > 0) {
+        struct iovec iov = {map, whole};
+        do {
+            ret = writev(logfd, &iov, 1);
+        } while (ret == -1 && errno == EINTR);
+    }
+    int err = ret == -1 ? errno : 0;
+    size_t written = ret > 0 ? ret : 0;
+    // A short write (say the log's disk filled up again) can cut a record.
+    // The records before the cut are dropped from the spool, so they're
+    // never logged twice, and the cut one is kept whole for next time.
+    // Its fragment in the log has no newline, and the log may take no more
+    // now, so what's kept starts with one: the next replay ends the
+    // fragment before logging the record again.
+    size_t moved = written;
+    while (moved > 0 && data[moved - 1] != '\n') {
+        moved--;
+    }
+    std::string rest(moved < written ? "\n" : "");
+    rest.append(data + moved, whole - moved);
+    (void)munmap(map, st.st_size);
+    if (written > 0 || whole < static_cast<size_t>(st.st_size)) {
+        if (!rest.empty() &&
+            pwrite(spool.fd(), rest.data(), rest.size(), 0) !=
+                static_cast<ssize_t>(rest.size())) {
+            return EIO;
+        }
+        if (ftruncate(spool.fd(), rest.size()) == -1) {
+            return errno;
+        }
+    }
+    if (bytes != nullptr) {
+        *bytes = moved;
+    }
+    if (!rest.empty()) {
+        return err != 0 ? err : EIO;
+    }
+    return 0;
+}
+
+}  // namespace mountwrapper
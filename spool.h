@@ -0,0 +1,66 @@
+/**
+ * @file spool.h
+ * @brief Somewhere to keep records while the log can't be written.
+ *
+ * If the log's directory can't be created, or the log can't be opened or
+ * written (disk full, filesystem gone read-only), the records go to a spool
+ * file for that log in memory-backed storage instead: /dev/shm (or /run
+ * if there's no /dev/shm) or the "spool_dir" option, which is created
+ * (mode 0700) if need be. Whichever wrapper next opens the log moves them
+ * into it ahead of its own records, as does 'mwspool -r'. Only if the
+ * spool fails too are records dumped to stdout, where they'd mix with the
+ * wrapped binary's output, with a warning on stderr. The "spool" option
+ * set to 0 goes straight to stdout, as before.
+ *
+ * A spool must be a regular file that only we can read or write. Anything
+ * else under its name is left alone, as it could be someone's attempt to
+ * get us to write elsewhere or to forge records.
+ *
+ * A spool is capped at "spool_bytes" (default 4MiB), all of it reserved
+ * when the spool is created so it can't be starved later. Access is
+ * serialised with flock(2), and each append is a single writev(2), so a
+ * spool only ever holds whole records.
+ */
+
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "mwinternal.h"
+
+namespace mountwrapper {
+
+static constexpr char kDefaultSpoolDir[] = "/dev/shm";
+static constexpr char kFallbackSpoolDir[] = "/run";
+static constexpr size_t kDefaultSpoolBytes = 4 << 20;
+
+// kDefaultSpoolDir, or kFallbackSpoolDir if there isn't one.
+std::string DefaultSpoolDir();
+
+// The spool for 'logfile' in 'dir'.
+std::string SpoolPath(const std::string& dir, const std::string& logfile);
+
+// The spool an invocation uses for 'logfile', or "" if spooling is off.
+std::string SpoolPathFor(const mw_invocation* inv,
+                         const std::string& logfile);
+
+// Append records[first...] to the spool. Returns false if they couldn't
+// all be spooled, in which case none were.
+bool SpoolRecords(const mw_invocation* inv,
+                  const std::string& logfile,
+                  const std::vector<std::string>& records,
+                  size_t first);
+
+// Move the records in 'spool' to the log open on 'logfd', in one write,
+// and empty the spool. Returns 0 (also if there was nothing to do) or an
+// errno value. If the write fails part way, the records that reached the
+// log whole are dropped from the spool and the rest, including any record
+// the write cut short, kept for next time. 'bytes' gets the amount moved.
+int ReplaySpool(const std::string& spool, int logfd, size_t* bytes);
+
+}  // namespace mountwrapper
+
+#endif  // SPOOL_H
@@ -0,0 +1,257 @@
+/**
+ * @file taskstats.cc
+ * @brief The child's delay accounting, from its exit taskstats. See
+ * taskstats.h.
+ *
+ * The kernel sends a task's taskstats to the listeners registered for the
+ * CPU it exits on, from do_exit() and so before the parent can reap it. We
+ * register for every CPU just before the fork, so by the time waitpid()
+ * returns the child's record is already queued on our socket, behind those
+ * of any other tasks that exited in the meantime. The receive buffer is
+ * sized for a busy node; if it overflows anyway we just go without.
+ */
+
+#include "taskstats.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+#include <linux/taskstats.h>
+#include <sys/socket.h>
+#include <sys/sysinfo.h>
+#include <unistd.h>
+
+namespace mountwrapper {
+
+namespace {
+
+constexpr int kReceiveBuffer = 4 << 20;
+
+// A request: the headers and room for one attribute.
+struct Request {
+    struct nlmsghdr nlh;
+    struct genlmsghdr genl;
+    char attrs[64];
+};
+
+void InitRequest(Request& req, uint16_t type, uint8_t cmd, uint16_t flags) {
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+    req.nlh.nlmsg_type = type;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | flags;
+    req.genl.cmd = cmd;
+    req.genl.version = 1;
+}
+
+bool PutAttr(Request& req, uint16_t type, const void* data, size_t len) {
+    size_t offset = NLMSG_ALIGN(req.nlh.nlmsg_len);
+    if (offset + NLA_HDRLEN + len > sizeof(req)) {
+        return false;
+    }
+    auto nla = reinterpret_cast<struct nlattr*>(
+        reinterpret_cast<char*>(&req) + offset);
+    nla->nla_type = type;
+    nla->nla_len = NLA_HDRLEN + len;
+    memcpy(reinterpret_cast<char*>(nla) + NLA_HDRLEN, data, len);
+    req.nlh.nlmsg_len = offset + NLA_ALIGN(nla->nla_len);
+    return true;
+}
+
+bool Send(int fd, const Request& req) {
+    struct sockaddr_nl kernel;
+    memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+    ssize_t ret;
+    do {
+        ret = sendto(fd, &req, req.nlh.nlmsg_len, 0,
+                     reinterpret_cast<struct sockaddr*>(&kernel),
+                     sizeof(kernel));
+    } while (ret == -1 && errno == EINTR);
+    return ret == static_cast<ssize_t>(req.nlh.nlmsg_len);
+}
+
+// Call fn(type, data, len) for each attribute in [data, data + len).
+template <typename Fn>
+void ForEachAttr(const char* data, size_t len, Fn fn) {
+    while (len >= NLA_HDRLEN) {
+        auto nla = reinterpret_cast<const struct nlattr*>(data);
+        if (nla->nla_len < NLA_HDRLEN || nla->nla_len > len) {
+            return;
+        }
+        fn(nla->nla_type & NLA_TYPE_MASK, data + NLA_HDRLEN,
+           nla->nla_len - NLA_HDRLEN);
+        size_t step = NLA_ALIGN(nla->nla_len);
+        if (step >= len) {
+            return;
+        }
+        data += step;
+        len -= step;
+    }
+}
+
+// Call fn(nlh) for each message received, until fn returns false or
+// there's nothing more to read (blocking or not).
+template <typename Fn>
+void ForEachMessage(int fd, bool block, Fn fn) {
+    static thread_local char buf[65536];
+    for (;;) {
+        ssize_t len = recv(fd, buf, sizeof(buf), block ? 0 : MSG_DONTWAIT);
+        if (len == -1) {
+            if (errno == EINTR || errno == ENOBUFS) {
+                continue;  // After an overflow, carry on with what's left.
+            }
+            return;
+        }
+        for (auto nlh = reinterpret_cast<struct nlmsghdr*>(buf);
+             NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (!fn(nlh)) {
+                return;
+            }
+        }
+    }
+}
+
+// The TASKSTATS generic netlink family's ID, or 0.
+uint16_t FamilyId(int fd) {
+    Request req;
+    InitRequest(req, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 0);
+    if (!PutAttr(req, CTRL_ATTR_FAMILY_NAME, TASKSTATS_GENL_NAME,
+                 sizeof(TASKSTATS_GENL_NAME)) ||
+        !Send(fd, req)) {
+        return 0;
+    }
+    uint16_t id = 0;
+    ForEachMessage(fd, true, [&](const struct nlmsghdr* nlh) {
+        if (nlh->nlmsg_type == NLMSG_ERROR) {
+            return false;
+        }
+        ForEachAttr(static_cast<const char*>(NLMSG_DATA(nlh)) + GENL_HDRLEN,
+                    nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN),
+                    [&](uint16_t type, const char* data, size_t len) {
+                        if (type == CTRL_ATTR_FAMILY_ID &&
+                            len >= sizeof(id)) {
+                            memcpy(&id, data, sizeof(id));
+                        }
+                    });
+        return false;
+    });
+    return id;
+}
+
+// "0-N" for every CPU that could come online.
+std::string AllCpus() {
+    return "0-" + std::to_string(get_nprocs_conf() - 1);
+}
+
+bool SetListener(int fd, uint16_t family, uint16_t attr, bool ack) {
+    std::string cpus = AllCpus();
+    Request req;
+    InitRequest(req, family, TASKSTATS_CMD_GET, ack ? NLM_F_ACK : 0);
+    if (!PutAttr(req, attr, cpus.c_str(), cpus.size() + 1) ||
+        !Send(fd, req)) {
+        return false;
+    }
+    if (!ack) {
+        return true;
+    }
+    int error = EIO;
+    ForEachMessage(fd, true, [&](const struct nlmsghdr* nlh) {
+        if (nlh->nlmsg_type != NLMSG_ERROR) {
+            return true;  // Someone else's exit, already.
+        }
+        auto err = static_cast<const struct nlmsgerr*>(NLMSG_DATA(nlh));
+        error = -err->error;
+        return false;
+    });
+    return error == 0;
+}
+
+}  // namespace
+
+void TaskstatsListen(mw_invocation* inv) {
+    if (GetOption(inv, "taskstats", "0") == "0") {
+        return;
+    }
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+    if (fd == -1) {
+        return;
+    }
+    int size = kReceiveBuffer;
+    // The forcing version ignores rmem_max, but needs CAP_NET_ADMIN, which
+    // we need anyway.
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) ==
+        -1) {
+        (void)setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+    uint16_t family = FamilyId(fd);
+    if (family == 0 ||
+        !SetListener(fd, family, TASKSTATS_CMD_ATTR_REGISTER_CPUMASK, true)) {
+        (void)close(fd);
+        return;
+    }
+    inv->taskstats_fd = fd;
+    inv->taskstats_family = family;
+}
+
+std::string TaskstatsCollect(mw_invocation* inv) {
+    if (inv->taskstats_fd == -1) {
+        return "";
+    }
+    struct taskstats stats;
+    bool found = false;
+    ForEachMessage(inv->taskstats_fd, false, [&](const struct nlmsghdr* nlh) {
+        if (nlh->nlmsg_type != inv->taskstats_family) {
+            return true;
+        }
+        // TASKSTATS_TYPE_AGGR_PID, holding TASKSTATS_TYPE_PID and then
+        // TASKSTATS_TYPE_STATS.
+        ForEachAttr(
+            static_cast<const char*>(NLMSG_DATA(nlh)) + GENL_HDRLEN,
+            nlh->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN),
+            [&](uint16_t type, const char* data, size_t len) {
+                if (type != TASKSTATS_TYPE_AGGR_PID) {
+                    return;
+                }
+                bool ours = false;
+                ForEachAttr(data, len, [&](uint16_t type, const char* data,
+                                           size_t len) {
+                    uint32_t pid;
+                    if (type == TASKSTATS_TYPE_PID && len >= sizeof(pid)) {
+                        memcpy(&pid, data, sizeof(pid));
+                        ours = static_cast<pid_t>(pid) == inv->pid;
+                    } else if (type == TASKSTATS_TYPE_STATS && ours) {
+                        // Older kernels send a shorter struct.
+                        memset(&stats, 0, sizeof(stats));
+                        memcpy(&stats, data, std::min(len, sizeof(stats)));
+                        found = true;
+                    }
+                });
+            });
+        return !found;
+    });
+    TaskstatsClose(inv);
+    if (!found) {
+        return "";
+    }
+    return " delay_ns:[blkio=" + std::to_string(stats.blkio_delay_total) +
+           ",swapin=" + std::to_string(stats.swapin_delay_total) +
+           ",freepages=" + std::to_string(stats.freepages_delay_total) +
+           ",thrashing=" + std::to_string(stats.thrashing_delay_total) +
+           ",cpu=" + std::to_string(stats.cpu_delay_total) + "]";
+}
+
+void TaskstatsClose(mw_invocation* inv) {
+    if (inv->taskstats_fd == -1) {
+        return;
+    }
+    (void)SetListener(inv->taskstats_fd, inv->taskstats_family,
+                      TASKSTATS_CMD_ATTR_DEREGISTER_CPUMASK, false);
+    (void)close(inv->taskstats_fd);
+    inv->taskstats_fd = -1;
+}
+
+}  // namespace mountwrapper
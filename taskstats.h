@@ -0,0 +1,34 @@
+/**
+ * @file taskstats.h
+ * @brief The child's delay accounting, from its exit taskstats.
+ *
+ * Before the fork, the wrapper registers a generic netlink listener for the
+ * taskstats the kernel sends as each task on the node exits; after reaping
+ * the child, it picks the child's out of what arrived. This needs
+ * CAP_NET_ADMIN, and the delays are only non-zero with delay accounting on
+ * (the delayacct boot option, or sysctl kernel.task_delayacct=1 on 5.14 and
+ * later). Only the child itself is covered, not any helpers it runs.
+ */
+
+#ifndef TASKSTATS_H
+#define TASKSTATS_H
+
+#include <string>
+
+#include "mwinternal.h"
+
+namespace mountwrapper {
+
+// Start listening, if the "taskstats" option is set. Best effort.
+void TaskstatsListen(mw_invocation* inv);
+
+// Once the child has been reaped, stop listening and return its delays as a
+// " delay_ns:[...]" field, or "" if they didn't arrive.
+std::string TaskstatsCollect(mw_invocation* inv);
+
+// Stop listening, if we still are.
+void TaskstatsClose(mw_invocation* inv);
+
+}  // namespace mountwrapper
+
+#endif  // TASKSTATS_H
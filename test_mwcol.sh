@@ -0,0 +1,106 @@
+#!/bin/bash
+#
+# End-to-end test of mwcol: converts a log of known records into an archive
+# of several row groups, and checks that scans give back exactly the rows
+# that went in, with and without predicates, that the footer statistics let
+# time-range scans skip row groups, and that a damaged archive is rejected
+# rather than misread.
+#
+# Usage: test_mwcol.sh [mwcol]
+
+set -eu
+
+mwcol=$(realpath "${1:-./mwcol}")
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+failures=0
+
+# Compares a command's stdout with what's expected.
+expect() {
+    local what=$1 expected=$2
+    shift 2
+    local got
+    got=$("$@" 2>/dev/null) || true
+    if [ "$got" != "$expected" ]; then
+        echo "$0: FAILED: $what" >&2
+        diff <(echo "$expected") <(echo "$got") >&2 || true
+        failures=$((failures + 1))
+    fi
+}
+
+# Ten runs of two binaries and two callers, each exit code, signal and
+# latency (up to 2^40ns, to need long varints) different, and the rows each
+# should scan back as. The execute record isn't a row.
+: >log
+: >rows
+for i in 0 1 2 3 4 5 6 7 8 9; do
+    case $((i % 3)) in
+        0) status=0 text="exit with code 0" ;;
+        1) status=32 text="exit with code 32" ;;
+        2) status=-9 text="exit with signal 9" ;;
+    esac
+    binary=/bin/mount$((i % 2))
+    caller=bash
+    if [ $((i % 4)) = 0 ]; then
+        caller=kubelet
+    fi
+    latency=$((i * 1000 + 7))
+    if [ $i = 9 ]; then
+        latency=1099511627776
+    fi
+    args="[\"$binary\",\"/mnt/$i\"]"
+    echo "2023-11-14T22:13:2$i.000000 runtimestamp 170000000$i.00000${i}000" \
+        "id 0000000$i-0000-7000-8000-000000000000 completed '$binary'" \
+        "args:$args $text latency_ns=$latency caller=$caller" >>log
+    echo "2023-11-14T22:13:2$i.00000$i $status $latency $binary $args" \
+        "$caller" >>rows
+done
+echo "2023-11-14T22:13:20.000000 runtimestamp 1700000000.000000000" \
+    "execute '/bin/x' argv:[] environment:[]" >>log
+
+"$mwcol" convert -r 4 archive log 2>/dev/null
+
+expect "full scan" "$(cat rows)" "$mwcol" scan archive
+expect "binary and failures" "$(awk '$4 == "/bin/mount1" && $2 != 0' rows)" \
+    "$mwcol" scan -b /bin/mount1 -F archive
+expect "caller" "$(awk '$6 == "kubelet"' rows)" \
+    "$mwcol" scan -c kubelet archive
+expect "status" "$(awk '$2 == -9' rows)" "$mwcol" scan -x -9 archive
+expect "time range" "$(sed -n 4,6p rows)" \
+    "$mwcol" scan -s 1700000003 -e 1700000006 archive
+expect "absent binary" "" "$mwcol" scan -b /bin/none archive
+expect "row groups skipped" "read 1 of 3 row groups" \
+    sh -c "'$mwcol' scan -s 1700000008 archive 2>&1 >/dev/null |
+        sed 's/.*: //'"
+
+# Overwrite all the column chunks, which follow the magic, with 0x7f: a
+# valid varint, but not a valid dictionary id.
+chunks=$("$mwcol" info archive | awk '$3 == "bytes" || $3 == "bytes," {
+    n += $2 } END { print n }')
+cp archive damaged
+head -c "$chunks" /dev/zero | tr '\0' '\177' |
+    dd of=damaged bs=1 seek=8 conv=notrunc 2>/dev/null
+expect "damaged archive" "" "$mwcol" scan damaged
+if "$mwcol" scan damaged >/dev/null 2>&1; then
+    echo "$0: FAILED: damaged archive accepted" >&2
+    failures=$((failures + 1))
+fi
+# The footer and trailer with the chunks cut out: the footer's offsets
+# all point past where the chunks now end.
+footer=$(($(stat -c %s archive) - 8 - chunks))
+{ head -c 8 archive; tail -c "$footer" archive; } >hollow
+if "$mwcol" scan hollow 2>&1 >/dev/null | grep -q "corrupt archive"; then
+    :
+else
+    echo "$0: FAILED: hollow archive not rejected as corrupt" >&2
+    failures=$((failures + 1))
+fi
+head -c 20 archive >truncated
+if "$mwcol" scan truncated >/dev/null 2>&1; then
+    echo "$0: FAILED: truncated archive accepted" >&2
+    failures=$((failures + 1))
+fi
+
+echo "$0: $failures failed" >&2
+[ $failures = 0 ]
@@ -0,0 +1,77 @@
+#!/bin/bash
+#
+# End-to-end test of mwcompare's Mann-Whitney U test on small, heavily tied
+# samples whose statistics are worked out by hand below. Without the tie
+# correction the first comparison's p would be 0.0656 and not significant.
+#
+# Usage: test_mwcompare.sh [mwcompare]
+
+set -eu
+
+mwcompare=$(realpath "${1:-./mwcompare}")
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+failures=0
+
+# Compares a command's stdout with what's expected.
+expect() {
+    local what=$1 expected=$2
+    shift 2
+    local got
+    got=$("$@" 2>/dev/null) || true
+    if [ "$got" != "$expected" ]; then
+        echo "$0: FAILED: $what" >&2
+        diff <(echo "$expected") <(echo "$got") >&2 || true
+        failures=$((failures + 1))
+    fi
+}
+
+# Writes a log of successful runs of /bin/mount with the given latencies.
+runs() {
+    local log=$1 i=0
+    shift
+    : >"$log"
+    for latency in "$@"; do
+        i=$((i + 1))
+        echo "2023-11-14T22:13:20.000000 runtimestamp 170000000$i.000000000" \
+            "id 0000000$i-0000-7000-8000-000000000000 completed" \
+            "'/bin/mount' args:[\"/bin/mount\"] exit with code 0" \
+            "latency_ns=$latency" >>"$log"
+    done
+}
+
+# The U test's line of a comparison, and its exit status.
+utest() {
+    local ret=0
+    "$mwcompare" -r 10 "$@" >out 2>/dev/null || ret=$?
+    head -1 out
+    echo "exit $ret"
+}
+
+# Pooled, 1 is tied three ways (ranks 1-3), 2 four ways (4-7, mean 5.5) and
+# 3 five ways (8-12, mean 10). The new ranks sum to 2 * 5.5 + 4 * 10 = 51,
+# so U = 51 - 6 * 7 / 2 = 30 of 36, against a mean of 18. The tie term is
+# 24 + 60 + 120 = 204, so the variance is 36 / 12 * (13 - 204 / 132) =
+# 34.36, z = (12 - 0.5) / 5.862 = 1.962, and p = 0.0498.
+runs base 1 1 1 2 2 3
+runs new 2 2 3 3 3 3
+expect "ties, slower" "/bin/mount: 6 vs 6 runs, P(new slower)=0.833,\
+ Mann-Whitney p=0.0498: SLOWER
+exit 2" utest base new
+expect "ties, faster" "/bin/mount: 6 vs 6 runs, P(new slower)=0.167,\
+ Mann-Whitney p=0.0498: faster
+exit 0" utest new base
+expect "ties, stricter" "/bin/mount: 6 vs 6 runs, P(new slower)=0.833,\
+ Mann-Whitney p=0.0498: no significant change
+exit 0" utest -c 0.99 base new
+
+# All tied: no variance at all, so nothing to test.
+runs base 5 5 5
+runs new 5 5
+expect "all tied" "/bin/mount: 3 vs 2 runs, P(new slower)=0.500,\
+ Mann-Whitney p=1: no significant change
+exit 0" utest base new
+
+echo "$0: $failures failed" >&2
+[ $failures = 0 ]
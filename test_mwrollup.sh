@@ -0,0 +1,93 @@
+#!/bin/bash
+#
+# End-to-end test of mwrollup: checks that rolling up a log a piece at a
+# time, with an update landing in the middle of a line, gives the same
+# buckets as rolling it up in one go; that an update with nothing new adds
+# nothing; that a torn record at the end of the rollup is discarded without
+# losing the checkpoints before it; and that a rotated log is read afresh.
+#
+# Usage: test_mwrollup.sh [mwrollup]
+
+set -eu
+
+mwrollup=$(realpath "${1:-./mwrollup}")
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir"
+failures=0
+
+# Compares a command's stdout with what's expected.
+expect() {
+    local what=$1 expected=$2
+    shift 2
+    local got
+    got=$("$@" 2>/dev/null) || true
+    if [ "$got" != "$expected" ]; then
+        echo "$0: FAILED: $what" >&2
+        diff <(echo "$expected") <(echo "$got") >&2 || true
+        failures=$((failures + 1))
+    fi
+}
+
+# The "rolled up N records" count of an update.
+rolled() {
+    "$mwrollup" update "$@" 2>&1 >/dev/null |
+        sed -n 's/.*rolled up \([0-9]*\) records.*/\1/p'
+}
+
+# Forty runs over three minutes and two hours, of two binaries and two
+# callers, some failing.
+: >log
+for i in $(seq 0 39); do
+    secs=$((1700000000 + i * 5 + (i / 20) * 3600))
+    status="exit with code 0"
+    case $((i % 7)) in
+        3) status="exit with code 32" ;;
+        5) status="exit with signal 9" ;;
+    esac
+    binary=/bin/mount$((i % 2))
+    caller=bash
+    if [ $((i % 3)) = 0 ]; then
+        caller=kubelet
+    fi
+    echo "2023-11-14T22:13:20.000000 runtimestamp $secs.000000000" \
+        "id 000000$((10 + i))-0000-7000-8000-000000000000 completed" \
+        "'$binary' args:[\"$binary\"] $status" \
+        "latency_ns=$((i * 100000 + 1000)) caller=$caller" >>log
+done
+
+"$mwrollup" update whole log 2>/dev/null
+minutes=$("$mwrollup" show -C whole)
+hours=$("$mwrollup" show -r hour whole)
+if [ "$(echo "$minutes" | wc -l)" -lt 8 ]; then
+    echo "$0: FAILED: too few buckets" >&2
+    failures=$((failures + 1))
+fi
+
+# The same log, appended in three pieces, the first ending mid-line.
+size=$(stat -c %s log)
+head -c $((size / 3)) log >growing
+expect "first piece" "$(tr -cd '\n' <growing | wc -c)" rolled pieces growing
+tail -c +$((size / 3 + 1)) log | head -c $((size / 3)) >>growing
+"$mwrollup" update pieces growing 2>/dev/null
+tail -c +$((2 * (size / 3) + 1)) log >>growing
+"$mwrollup" update pieces growing 2>/dev/null
+expect "pieces, minutes" "$minutes" "$mwrollup" show -C pieces
+expect "pieces, hours" "$hours" "$mwrollup" show -r hour pieces
+expect "nothing new" 0 rolled pieces growing
+
+# A torn bucket after the last trailer: discarded, and the checkpoints
+# before it still hold.
+cp pieces torn
+printf '\001\100partial' >>torn
+expect "torn tail" 0 rolled torn growing
+expect "torn tail, minutes" "$minutes" "$mwrollup" show -C torn
+expect "after torn tail" 0 rolled torn growing
+
+# A rotated log (a new inode) is read from the start.
+cp growing rotated
+mv rotated growing
+expect "rotated" 40 rolled pieces growing
+
+echo "$0: $failures failed" >&2
+[ $failures = 0 ]
@@ -0,0 +1,184 @@
+/**
+ * @file test_records.cc
+ * @brief Unit tests of the record fields: capped lists, canonicalised
+ * values and their fingerprints, and parsing records back.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "logrecord.h"
+#include "mwinternal.h"
+#include "testing.h"
+#include "xxhash64.h"
+
+using mountwrapper::CanonicaliseString;
+using mountwrapper::GetMapString;
+using mountwrapper::GetVecString;
+using mountwrapper::kMaxEnvVarValueLength;
+
+namespace {
+
+std::string Hex(uint64_t v) {
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(v));
+    return buf;
+}
+
+// The number in a trailing "...+N more", or 0 if there isn't one.
+size_t Omitted(const std::string& list) {
+    auto pos = list.rfind("...+");
+    if (pos == std::string::npos || list.size() < 5 ||
+        list.compare(list.size() - 5, 5, " more") != 0) {
+        return 0;
+    }
+    return std::stoul(list.substr(pos + 4));
+}
+
+// The list without its marker, if it has one.
+std::string Kept(const std::string& list) {
+    if (Omitted(list) == 0) {
+        return list;
+    }
+    auto pos = list.rfind("...+");
+    return list.substr(0, pos == 0 ? 0 : pos - 1);
+}
+
+// The number of items in a list, counting the character each ends with.
+size_t Items(const std::string& list, char end) {
+    size_t items = 0;
+    for (size_t n = 0; n < list.size(); n++) {
+        items += list[n] == end &&
+                 (n + 1 == list.size() || list[n + 1] == ',');
+    }
+    return items;
+}
+
+// Whether 'kept' is 'whole' cut short at an item boundary.
+bool IsPrefix(const std::string& kept, const std::string& whole) {
+    return kept.empty() || (whole.compare(0, kept.size(), kept) == 0 &&
+                            (kept.size() == whole.size() ||
+                             whole[kept.size()] == ','));
+}
+
+void TestVecString() {
+    EXPECT_EQ(GetVecString({}), "");
+    EXPECT_EQ(GetVecString({"a", "b c"}), "\"a\",\"b c\"");
+
+    std::vector<std::string> vec;
+    for (int n = 0; n < 200; n++) {
+        vec.push_back("item-" + std::to_string(n));
+    }
+    std::string whole = GetVecString(vec);
+    EXPECT_EQ(GetVecString(vec, whole.size()), whole);
+    EXPECT_EQ(Omitted(whole), 0u);
+
+    // However tight the cap, the list fits it (given room for the marker),
+    // keeps a prefix of the items, and accounts for the rest.
+    for (size_t cap = 0; cap < whole.size(); cap += 7) {
+        std::string list = GetVecString(vec, cap);
+        EXPECT(list.size() <= std::max<size_t>(cap, 32));
+        EXPECT_EQ(Items(Kept(list), '"') + Omitted(list), vec.size());
+        EXPECT(IsPrefix(Kept(list), whole));
+    }
+    EXPECT_EQ(GetVecString(vec, 0), "...+200 more");
+}
+
+void TestMapString() {
+    std::map<std::string, std::string> map;
+    EXPECT_EQ(GetMapString(map), "");
+    map["A"] = "1";
+    map["B"] = "two";
+    EXPECT_EQ(GetMapString(map), "A=1,B=two");
+    EXPECT_EQ(GetMapString(map, 4), "...+2 more");
+
+    for (int n = 0; n < 500; n++) {
+        map["VAR_" + std::to_string(n)] = std::string(n % 50, 'x');
+    }
+    std::string whole = GetMapString(map);
+    for (size_t cap = 64; cap < whole.size(); cap += 101) {
+        std::string list = GetMapString(map, cap);
+        EXPECT(list.size() <= cap);
+        size_t kept = 0;
+        for (char c : list) {
+            kept += c == '=';
+        }
+        EXPECT_EQ(kept + Omitted(list), map.size());
+        EXPECT(IsPrefix(Kept(list), whole));
+    }
+}
+
+void TestCanonicalise() {
+    EXPECT_EQ(CanonicaliseString(""), "");
+    EXPECT_EQ(CanonicaliseString("plain value"), "plain value");
+    EXPECT_EQ(CanonicaliseString("a\nb\tc\x01\xff"), "a.b.c..");
+
+    std::string limit(kMaxEnvVarValueLength, 'v');
+    EXPECT_EQ(CanonicaliseString(limit), limit);
+
+    // Long values keep their start and gain a fingerprint of the whole.
+    std::string a = limit + "-tail-a";
+    std::string b = limit + "-tail-b";
+    std::string ca = CanonicaliseString(a);
+    std::string cb = CanonicaliseString(b);
+    EXPECT_EQ(ca, std::string(kMaxEnvVarValueLength - 3, 'v') + "...#" +
+                      Hex(mountwrapper::XxHash64(a.data(), a.size())));
+    EXPECT(ca != cb);
+    EXPECT_EQ(ca.size(), cb.size());
+    EXPECT_EQ(CanonicaliseString(a), ca);
+    // The fingerprint is of the raw value, not the sanitised one.
+    EXPECT(CanonicaliseString(limit + "\n") !=
+           CanonicaliseString(limit + "."));
+}
+
+void TestXxHash64() {
+    EXPECT_EQ(Hex(mountwrapper::XxHash64("", 0)), "ef46db3751d8e999");
+    EXPECT_EQ(Hex(mountwrapper::XxHash64("a", 1)), "d24ec4f1a98c6e5b");
+    EXPECT_EQ(Hex(mountwrapper::XxHash64("abc", 3)), "44bc2cf5ad770999");
+}
+
+void TestParseRecord() {
+    mountwrapper::LogRecord rec;
+    std::string line =
+        "2026-10-18T04:19:46.363190 runtimestamp 1792297186.362163372 id "
+        "01a14d3c-b43a-72c8-8be6-06b1fe78f129 completed '/bin/true' "
+        "args:[\"/usr/bin/mount\",\"-a\",...+3 more] exit with code 32 "
+        "latency_ns=663651 caller=kubelet "
+        "overhead_ns:[copy=17657,fork=636959]";
+    EXPECT(mountwrapper::ParseLogRecord(line, rec));
+    EXPECT_EQ(rec.kind, "completed");
+    EXPECT_EQ(rec.id, "01a14d3c-b43a-72c8-8be6-06b1fe78f129");
+    EXPECT_EQ(rec.binary, "/bin/true");
+    EXPECT_EQ(rec.runtimestamp_ns, 1792297186362163372LL);
+    EXPECT(rec.has_status);
+    EXPECT_EQ(rec.status, 32);
+    EXPECT_EQ(rec.latency_ns, 663651);
+    EXPECT_EQ(rec.caller, "kubelet");
+    EXPECT_EQ(rec.overhead_ns.size(), 2u);
+    EXPECT(rec.args.find("...+3 more") != std::string::npos);
+
+    std::string signalled =
+        "2026-10-18T04:19:46.363190 runtimestamp 1792297186.362163372 "
+        "completed '/bin/x' args:[\"x\"] exit with signal 9 latency_ns=5";
+    EXPECT(mountwrapper::ParseLogRecord(signalled, rec));
+    EXPECT_EQ(rec.status, -9);
+    EXPECT_EQ(rec.caller, "");
+    EXPECT(rec.id.empty());
+
+    EXPECT(!mountwrapper::ParseLogRecord("mount: some output", rec));
+    EXPECT_EQ(rec.kind, "");
+}
+
+}  // namespace
+
+int main(int, char* argv[]) {
+    TestVecString();
+    TestMapString();
+    TestCanonicalise();
+    TestXxHash64();
+    TestParseRecord();
+    return mountwrapper::TestResult(argv[0]);
+}
@@ -0,0 +1,170 @@
+/**
+ * @file test_sketch.cc
+ * @brief Unit tests of LatencySketch: quantile accuracy, merging and the
+ * encoding mwrollup stores.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "sketch.h"
+#include "testing.h"
+#include "varint.h"
+
+using mountwrapper::LatencySketch;
+
+namespace {
+
+const double kQuantiles[] = {0, 0.01, 0.25, 0.5, 0.9, 0.99, 0.999, 1};
+
+// The exact q-quantile, ranked the way the sketch ranks.
+double Exact(std::vector<int64_t> values, double q) {
+    std::sort(values.begin(), values.end());
+    return values[std::llround(q * (values.size() - 1))];
+}
+
+// Whether every quantile is within the sketch's relative accuracy.
+void ExpectAccurate(const LatencySketch& sketch,
+                    const std::vector<int64_t>& values) {
+    EXPECT_EQ(sketch.count(), values.size());
+    EXPECT_EQ(sketch.min(), *std::min_element(values.begin(), values.end()));
+    EXPECT_EQ(sketch.max(), *std::max_element(values.begin(), values.end()));
+    for (double q : kQuantiles) {
+        double exact = Exact(values, q);
+        double got = sketch.Quantile(q);
+        EXPECT(std::abs(got - exact) <=
+               LatencySketch::kDefaultAccuracy * std::abs(exact) + 1e-9);
+    }
+}
+
+std::vector<int64_t> Sample(int distribution, size_t n,
+                            std::mt19937_64& rng) {
+    std::vector<int64_t> values;
+    std::lognormal_distribution<double> lognormal(13.5, 1.2);  // ~1ms.
+    std::uniform_int_distribution<int64_t> uniform(1, 1000000000);
+    for (size_t i = 0; i < n; i++) {
+        switch (distribution) {
+            case 0:
+                values.push_back(1 + static_cast<int64_t>(lognormal(rng)));
+                break;
+            case 1:
+                values.push_back(uniform(rng));
+                break;
+            default:
+                // Bimodal: fast local mounts and slow NFS ones.
+                values.push_back(i % 10 == 0 ? 2000000000 + i : 500000 + i);
+        }
+    }
+    return values;
+}
+
+void TestAccuracy() {
+    std::mt19937_64 rng(42);
+    for (int distribution = 0; distribution < 3; distribution++) {
+        for (size_t n : {1, 2, 10, 1000, 100000}) {
+            auto values = Sample(distribution, n, rng);
+            LatencySketch sketch;
+            for (int64_t v : values) {
+                sketch.Add(v);
+            }
+            ExpectAccurate(sketch, values);
+        }
+    }
+
+    LatencySketch empty;
+    EXPECT_EQ(empty.count(), 0u);
+    EXPECT_EQ(empty.Quantile(0.5), 0);
+    EXPECT_EQ(empty.mean(), 0);
+
+    // Zero (or, from a clock step, negative) latencies sort first.
+    LatencySketch zeros;
+    std::vector<int64_t> values = {0, 0, -5, 100, 200};
+    for (int64_t v : values) {
+        zeros.Add(v);
+    }
+    EXPECT_EQ(zeros.min(), -5);
+    EXPECT(zeros.Quantile(0) <= 0);
+    EXPECT(std::abs(zeros.Quantile(1) - 200) <= 2);
+}
+
+void TestMerge() {
+    std::mt19937_64 rng(7);
+    auto a = Sample(0, 5000, rng);
+    auto b = Sample(2, 3000, rng);
+    LatencySketch sa, sb, all;
+    for (int64_t v : a) {
+        sa.Add(v);
+        all.Add(v);
+    }
+    for (int64_t v : b) {
+        sb.Add(v);
+        all.Add(v);
+    }
+    sa.Merge(sb);
+    std::vector<int64_t> both = a;
+    both.insert(both.end(), b.begin(), b.end());
+    ExpectAccurate(sa, both);
+    for (double q : kQuantiles) {
+        EXPECT_EQ(sa.Quantile(q), all.Quantile(q));
+    }
+    EXPECT(std::abs(sa.mean() - all.mean()) <= 1e-6 * all.mean());
+
+    // Merging with an empty sketch, either way round, changes nothing.
+    LatencySketch empty;
+    LatencySketch copy = sb;
+    copy.Merge(empty);
+    empty.Merge(sb);
+    for (double q : kQuantiles) {
+        EXPECT_EQ(copy.Quantile(q), sb.Quantile(q));
+        EXPECT_EQ(empty.Quantile(q), sb.Quantile(q));
+    }
+    // Adding n at once is adding it n times.
+    LatencySketch bulk, one_by_one;
+    bulk.Add(12345, 1000);
+    for (int i = 0; i < 1000; i++) {
+        one_by_one.Add(12345);
+    }
+    EXPECT_EQ(bulk.count(), one_by_one.count());
+    EXPECT_EQ(bulk.Quantile(0.5), one_by_one.Quantile(0.5));
+}
+
+void TestEncoding() {
+    std::mt19937_64 rng(99);
+    auto values = Sample(1, 20000, rng);
+    LatencySketch sketch;
+    for (int64_t v : values) {
+        sketch.Add(v);
+    }
+    std::string out;
+    sketch.Encode(out);
+    mountwrapper::VarintReader r(out.data(), out.size());
+    LatencySketch decoded;
+    EXPECT(decoded.Decode(r));
+    EXPECT_EQ(r.remaining(), 0u);
+    EXPECT_EQ(decoded.count(), sketch.count());
+    EXPECT_EQ(decoded.min(), sketch.min());
+    EXPECT_EQ(decoded.max(), sketch.max());
+    for (double q : kQuantiles) {
+        EXPECT_EQ(decoded.Quantile(q), sketch.Quantile(q));
+    }
+
+    // Every truncation fails rather than decoding something else.
+    for (size_t len = 0; len < out.size(); len++) {
+        mountwrapper::VarintReader cut(out.data(), len);
+        LatencySketch partial;
+        EXPECT(!partial.Decode(cut));
+    }
+}
+
+}  // namespace
+
+int main(int, char* argv[]) {
+    TestAccuracy();
+    TestMerge();
+    TestEncoding();
+    return mountwrapper::TestResult(argv[0]);
+}
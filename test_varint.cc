@@ -0,0 +1,127 @@
+/**
+ * @file test_varint.cc
+ * @brief Unit tests of the varint and zigzag encodings under the tools'
+ * binary formats.
+ */
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "testing.h"
+#include "varint.h"
+
+using mountwrapper::PutString;
+using mountwrapper::PutVarint;
+using mountwrapper::UnZigZag;
+using mountwrapper::VarintReader;
+using mountwrapper::ZigZag;
+
+namespace {
+
+const int64_t kSigned[] = {0,
+                           1,
+                           -1,
+                           63,
+                           -64,
+                           64,
+                           -65,
+                           1000000007,
+                           -1000000007,
+                           std::numeric_limits<int64_t>::max(),
+                           std::numeric_limits<int64_t>::min()};
+
+void TestZigZag() {
+    // Small magnitudes of either sign map to small codes.
+    EXPECT_EQ(ZigZag(0), 0u);
+    EXPECT_EQ(ZigZag(-1), 1u);
+    EXPECT_EQ(ZigZag(1), 2u);
+    EXPECT_EQ(ZigZag(-2), 3u);
+    EXPECT_EQ(ZigZag(std::numeric_limits<int64_t>::max()),
+              std::numeric_limits<uint64_t>::max() - 1);
+    EXPECT_EQ(ZigZag(std::numeric_limits<int64_t>::min()),
+              std::numeric_limits<uint64_t>::max());
+    for (int64_t v : kSigned) {
+        EXPECT_EQ(UnZigZag(ZigZag(v)), v);
+    }
+}
+
+void TestVarint() {
+    std::string out;
+    PutVarint(out, 0);
+    EXPECT_EQ(out, std::string(1, '\0'));
+    out.clear();
+    PutVarint(out, 300);
+    EXPECT_EQ(out, "\xac\x02");
+    out.clear();
+    PutVarint(out, std::numeric_limits<uint64_t>::max());
+    EXPECT_EQ(out.size(), 10u);
+
+    // A sequence of everything reads back in order, then stops cleanly.
+    out.clear();
+    std::vector<uint64_t> values;
+    for (int shift = 0; shift < 64; shift++) {
+        values.push_back((uint64_t{1} << shift) - 1);
+        values.push_back(uint64_t{1} << shift);
+    }
+    for (int64_t v : kSigned) {
+        values.push_back(ZigZag(v));
+    }
+    for (uint64_t v : values) {
+        PutVarint(out, v);
+    }
+    PutString(out, "");
+    PutString(out, std::string("with\0nul", 8));
+    VarintReader r(out.data(), out.size());
+    for (uint64_t v : values) {
+        uint64_t got;
+        EXPECT(r.Varint(got));
+        EXPECT_EQ(got, v);
+    }
+    std::string str;
+    EXPECT(r.String(str));
+    EXPECT_EQ(str, "");
+    EXPECT(r.String(str));
+    EXPECT_EQ(str, std::string("with\0nul", 8));
+    EXPECT_EQ(r.remaining(), 0u);
+    EXPECT(r.ok());
+    uint64_t v;
+    EXPECT(!r.Varint(v));
+    EXPECT(!r.ok());
+}
+
+void TestMalformed() {
+    uint64_t v;
+    std::string str;
+
+    // Cut off mid-varint.
+    std::string out;
+    PutVarint(out, 1 << 20);
+    VarintReader truncated(out.data(), out.size() - 1);
+    EXPECT(!truncated.Varint(v));
+
+    // More than ten bytes of continuation.
+    std::string endless(11, '\x80');
+    VarintReader overlong(endless.data(), endless.size());
+    EXPECT(!overlong.Varint(v));
+
+    // A string longer than what's left, and everything after it fails.
+    out.clear();
+    PutVarint(out, 100);
+    out += "short";
+    PutVarint(out, 1);
+    VarintReader shortstr(out.data(), out.size());
+    EXPECT(!shortstr.String(str));
+    EXPECT(!shortstr.Varint(v));
+    EXPECT(!shortstr.ok());
+}
+
+}  // namespace
+
+int main(int, char* argv[]) {
+    TestZigZag();
+    TestVarint();
+    TestMalformed();
+    return mountwrapper::TestResult(argv[0]);
+}
@@ -0,0 +1,69 @@
+/**
+ * @file testing.h
+ * @brief Just enough of a harness for the unit tests run by 'make check'.
+ *
+ * A test binary is a main() of EXPECT()s that ends by returning
+ * TestResult(). Failures are reported as they happen, with their source
+ * line, and don't stop the rest of the tests.
+ */
+
+#ifndef TESTING_H
+#define TESTING_H
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+namespace mountwrapper {
+
+inline int& TestFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+inline int& TestChecks() {
+    static int checks = 0;
+    return checks;
+}
+
+inline void TestCheck(bool ok,
+                      const char* expr,
+                      const std::string& detail,
+                      const char* file,
+                      int line) {
+    TestChecks()++;
+    if (!ok) {
+        TestFailures()++;
+        std::cerr << file << ":" << line << ": FAILED: " << expr << detail
+                  << "\n";
+    }
+}
+
+template <typename A, typename B>
+void TestCheckEq(const A& a,
+                 const B& b,
+                 const char* expr,
+                 const char* file,
+                 int line) {
+    std::ostringstream detail;
+    if (!(a == b)) {
+        detail << "\n  got:      " << a << "\n  expected: " << b;
+    }
+    TestCheck(a == b, expr, detail.str(), file, line);
+}
+
+// What main() returns: EXIT_SUCCESS if every check passed.
+inline int TestResult(const char* progname) {
+    std::cerr << progname << ": " << TestChecks() << " checks, "
+              << TestFailures() << " failed\n";
+    return TestFailures() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+}  // namespace mountwrapper
+
+#define EXPECT(cond) \
+    mountwrapper::TestCheck((cond), #cond, "", __FILE__, __LINE__)
+#define EXPECT_EQ(a, b) \
+    mountwrapper::TestCheckEq((a), (b), #a " == " #b, __FILE__, __LINE__)
+
+#endif  // TESTING_H
@@ -0,0 +1,260 @@
+/**
+ * @file trace.cc
+ * @brief W3C trace context propagation and OTLP/JSON span export.
+ *
+ * If the caller's environment has a valid TRACEPARENT, the invocation becomes
+ * a child span of it (with the "trace" option set to 1, an invocation
+ * without one starts a new trace instead). The child gets a TRACEPARENT
+ * naming our span, so whatever mount.real does is attributed to us.
+ *
+ * Sampled spans are exported once the child has been reaped and its records
+ * logged, as one OTLP/JSON ExportTraceServiceRequest per line, to the file
+ * or Unix stream socket ("unix:/path") named by the "otlp_output" option.
+ * Export is best-effort and bounded in time. There are four spans:
+ * the invocation, and under it fork (until fork() returns in the parent),
+ * exec (until the child's exec succeeds or fails, seen as EOF on a
+ * close-on-exec pipe) and wait (until the child is reaped).
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mwinternal.h"
+
+namespace mountwrapper {
+
+static constexpr char kUnixPrefix[] = "unix:";
+
+// How long a collector socket may block us, connecting or writing.
+static constexpr int kCollectorTimeoutMs = 100;
+
+static bool IsLowerHex(const std::string& str) {
+    return str.find_first_not_of("0123456789abcdef") == std::string::npos;
+}
+
+static std::string HexId(size_t words) {
+    std::string out;
+    char buf[17];
+    for (size_t n = 0; n < words; n++) {
+        uint64_t r;
+        do {
+            r = RandomU64();
+        } while (r == 0);  // All-zero IDs are invalid.
+        snprintf(buf, sizeof(buf), "%016llx",
+                 static_cast<unsigned long long>(r));
+        out += buf;
+    }
+    return out;
+}
+
+void TraceStart(mw_invocation* inv, const std::string& traceparent) {
+    auto& tc = inv->trace;
+    // version-traceid-parentid-flags, e.g.
+    // 00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01
+    if (traceparent.size() >= 55 && traceparent[2] == '-' &&
+        traceparent[35] == '-' && traceparent[52] == '-' &&
+        traceparent.compare(0, 2, "ff") != 0 &&
+        (traceparent.size() == 55 || traceparent[55] == '-')) {
+        std::string trace_id = traceparent.substr(3, 32);
+        std::string parent = traceparent.substr(36, 16);
+        std::string flags = traceparent.substr(53, 2);
+        if (IsLowerHex(traceparent.substr(0, 2)) && IsLowerHex(trace_id) &&
+            IsLowerHex(parent) && IsLowerHex(flags) &&
+            trace_id != std::string(32, '0') &&
+            parent != std::string(16, '0')) {
+            tc.active = true;
+            tc.trace_id = trace_id;
+            tc.parent_span_id = parent;
+            tc.flags = strtoul(flags.c_str(), nullptr, 16);
+        }
+    }
+    if (!tc.active && GetOption(inv, "trace", "0") == "1") {
+        tc.active = true;
+        tc.trace_id = HexId(2);
+        tc.flags = 0x01;
+    }
+    if (!tc.active) {
+        return;
+    }
+    tc.sampled = (tc.flags & 0x01) && GetOption(inv, "otlp_output", "") != "";
+    tc.span_id = HexId(1);
+
+    struct timespec rt;
+    clock_gettime(CLOCK_REALTIME, &rt);
+    tc.realtime_offset_ns = static_cast<int64_t>(rt.tv_sec) * 1000000000LL +
+                            rt.tv_nsec - MonotonicNs();
+}
+
+std::string TraceParentForChild(const mw_invocation* inv) {
+    char flags[3];
+    snprintf(flags, sizeof(flags), "%02x", inv->trace.flags);
+    return "00-" + inv->trace.trace_id + "-" + inv->trace.span_id + "-" +
+           flags;
+}
+
+namespace {
+
+std::string JsonString(const std::string& str) {
+    std::string out = "\"";
+    for (unsigned char c : str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+void Attribute(std::ostringstream& ss,
+               bool& first,
+               const std::string& key,
+               const std::string& value) {
+    ss << (first ? "" : ",") << "{\"key\":" << JsonString(key)
+       << ",\"value\":{\"stringValue\":" << JsonString(value) << "}}";
+    first = false;
+}
+
+void IntAttribute(std::ostringstream& ss,
+                  bool& first,
+                  const std::string& key,
+                  int64_t value) {
+    // OTLP/JSON encodes 64-bit integers as strings.
+    ss << (first ? "" : ",") << "{\"key\":" << JsonString(key)
+       << ",\"value\":{\"intValue\":\"" << value << "\"}}";
+    first = false;
+}
+
+void Span(std::ostringstream& ss,
+          const mw_invocation* inv,
+          const std::string& span_id,
+          const std::string& parent_id,
+          const std::string& name,
+          int64_t start_ns,
+          int64_t end_ns,
+          bool error,
+          const std::string& attributes) {
+    const auto& tc = inv->trace;
+    ss << "{\"traceId\":\"" << tc.trace_id << "\",\"spanId\":\"" << span_id
+       << "\"";
+    if (!parent_id.empty()) {
+        ss << ",\"parentSpanId\":\"" << parent_id << "\"";
+    }
+    ss << ",\"name\":" << JsonString(name)
+       << ",\"kind\":1,\"startTimeUnixNano\":\""
+       << start_ns + tc.realtime_offset_ns << "\",\"endTimeUnixNano\":\""
+       << end_ns + tc.realtime_offset_ns << "\",\"attributes\":["
+       << attributes << "],\"status\":{\"code\":" << (error ? 2 : 1)
+       << "}}";
+}
+
+// Tracing is best-effort, so nothing here may hang or kill us: the socket
+// has a send timeout (which also bounds connect()), the write can't raise
+// SIGPIPE, and a file that's a FIFO without a reader is an error.
+int WriteToCollector(const std::string& target, const std::string& line) {
+    int fd;
+    bool socket_fd = target.rfind(kUnixPrefix, 0) == 0;
+    if (socket_fd) {
+        std::string path = target.substr(strlen(kUnixPrefix));
+        struct sockaddr_un addr;
+        if (path.size() >= sizeof(addr.sun_path)) {
+            return ENAMETOOLONG;
+        }
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, path.c_str(), path.size());
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1) {
+            return errno;
+        }
+        struct timeval timeout = {0, kCollectorTimeoutMs * 1000};
+        if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+                       sizeof(timeout)) == -1 ||
+            connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                    sizeof(addr)) == -1) {
+            int err = errno;
+            (void)close(fd);
+            return err;
+        }
+    } else {
+        fd = open(target.c_str(),
+                  O_CREAT | O_WRONLY | O_APPEND | O_NONBLOCK | O_CLOEXEC,
+                  0644);
+        if (fd == -1) {
+            return errno;
+        }
+    }
+    int err = 0;
+    ssize_t written = socket_fd
+                          ? send(fd, line.c_str(), line.size(), MSG_NOSIGNAL)
+                          : write(fd, line.c_str(), line.size());
+    if (written != static_cast<ssize_t>(line.size())) {
+        err = errno != 0 ? errno : EIO;
+    }
+    (void)close(fd);
+    return err;
+}
+
+}  // namespace
+
+void TraceExport(const mw_invocation* inv) {
+    const auto& tc = inv->trace;
+    if (!tc.sampled || !inv->reaped) {
+        return;
+    }
+
+    bool error = inv->failed;
+    std::ostringstream attrs;
+    bool first = true;
+    Attribute(attrs, first, "mountwrapper.invocation_id", inv->id);
+    Attribute(attrs, first, "process.executable.path", inv->binary);
+    Attribute(attrs, first, "process.command_args", inv->argstr);
+    IntAttribute(attrs, first, "process.pid", inv->pid);
+    if (WIFEXITED(inv->wstatus)) {
+        IntAttribute(attrs, first, "process.exit.code",
+                     WEXITSTATUS(inv->wstatus));
+    } else if (WIFSIGNALED(inv->wstatus)) {
+        IntAttribute(attrs, first, "process.exit.signal",
+                     WTERMSIG(inv->wstatus));
+    }
+
+    std::ostringstream ss;
+    ss << "{\"resourceSpans\":[{\"resource\":{\"attributes\":["
+       << "{\"key\":\"service.name\",\"value\":{\"stringValue\":"
+       << "\"mountwrapper\"}}]},\"scopeSpans\":[{\"scope\":{\"name\":"
+       << "\"mountwrapper\"},\"spans\":[";
+    Span(ss, inv, tc.span_id, tc.parent_span_id,
+         "exec " + inv->progname, inv->spawn_ns, inv->exit_ns, error,
+         attrs.str());
+    ss << ",";
+    Span(ss, inv, HexId(1), tc.span_id, "fork", inv->spawn_ns,
+         tc.forked_ns, false, "");
+    ss << ",";
+    Span(ss, inv, HexId(1), tc.span_id, "exec", tc.forked_ns, tc.exec_ns,
+         WIFEXITED(inv->wstatus) && WEXITSTATUS(inv->wstatus) == 128, "");
+    ss << ",";
+    Span(ss, inv, HexId(1), tc.span_id, "wait", tc.exec_ns, inv->exit_ns,
+         error, "");
+    ss << "]}]}]}\n";
+
+    // Tracing is best-effort: a missing collector mustn't fail the mount.
+    (void)WriteToCollector(GetOption(inv, "otlp_output", ""), ss.str());
+}
+
+}  // namespace mountwrapper
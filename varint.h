@@ -0,0 +1,80 @@
+/**
+ * @file varint.h
+ * @brief LEB128 varints and zigzag encoding for the tools' binary formats.
+ */
+
+#ifndef VARINT_H
+#define VARINT_H
+
+#include <cstdint>
+#include <string>
+
+namespace mountwrapper {
+
+inline uint64_t ZigZag(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+inline int64_t UnZigZag(uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+inline void PutVarint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+inline void PutString(std::string& out, const std::string& str) {
+    PutVarint(out, str.size());
+    out += str;
+}
+
+// Reads varints and strings from a buffer. Once a read runs off the end or
+// hits a malformed varint, it and all later reads fail.
+class VarintReader {
+   public:
+    VarintReader(const char* data, size_t size)
+        : p_(data), end_(data + size) {}
+
+    bool Varint(uint64_t& v) {
+        v = 0;
+        for (int shift = 0; ok_ && shift < 64; shift += 7) {
+            if (p_ == end_) {
+                break;
+            }
+            uint8_t b = *p_++;
+            v |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                return true;
+            }
+        }
+        ok_ = false;
+        return false;
+    }
+
+    bool String(std::string& str) {
+        uint64_t len;
+        if (!Varint(len) || len > static_cast<uint64_t>(end_ - p_)) {
+            ok_ = false;
+            return false;
+        }
+        str.assign(p_, len);
+        p_ += len;
+        return true;
+    }
+
+    bool ok() const { return ok_; }
+    size_t remaining() const { return end_ - p_; }
+
+   private:
+    const char* p_;
+    const char* end_;
+    bool ok_ = true;
+};
+
+}  // namespace mountwrapper
+
+#endif  // VARINT_H